@@ -32,6 +32,7 @@ struct ColumnInfo {
   std::string type;
   bool nullable;
   bool primaryKey;
+  int keyPosition = 0; // ordinal position in the primary key
   bool operator==(const ColumnInfo&) const = default;
 };
 
@@ -41,6 +42,8 @@ std::ostream& operator<<(std::ostream& stream, const ColumnInfo& var);
 
 struct TableInfo {
   std::vector<ColumnInfo> columns;
+  std::size_t rows = 0; // estimate from information_schema
+  std::size_t bytes = 0; // data length from information_schema
 };
 
 std::ostream& operator<<(std::ostream& stream, const TableInfo& var);
@@ -95,7 +98,11 @@ public:
   const std::string& lastError() const { return error; }
   void transactionBegin();
   void transactionCommit();
+  void transactionRollback();
   bool query(const std::string& sql, std::function<void(const soci::row&)> consumer);
+  bool query(const std::string& sql,
+             std::function<void(soci::statement&)> binder,
+             std::function<void(const soci::row&)> consumer);
   bool exec(const std::string& sql);
 
 protected:
@@ -119,8 +126,12 @@ public:
   DbMeta(const std::string ref)
       : DbBase{ ref } {}
   virtual ~DbMeta(){};
-  bool
-  open(const std::string& host, int port, const std::string& schema, const std::string& user, const std::string& pwd);
+  bool open(const std::string& host,
+            int port,
+            const std::string& schema,
+            const std::string& user,
+            const std::string& pwd,
+            bool localInfile = false);
   bool loadTables(strings& tables);
   bool loadMetadata(std::set<std::string> tables);
   void logTableInfo() const;
@@ -135,11 +146,13 @@ private:
   MetadataMap map;
   static const std::string SQL_TABLES;
   static const std::string SQL_COLUMNS;
+  static const std::string SQL_ROWS;
 };
 
 /*****************************************************************************/
 
 class Operation;
+class KeyFlags;
 class TableKeys;
 class TableKeysIterator;
 class TableData;
@@ -153,15 +166,37 @@ public:
   virtual ~Db() {}
   bool open() { return DbBase::open(meta->connectionString()); }
   bool loadPk(bool source, const std::string& table, TableKeys& data, std::size_t bulk);
+  bool loadPkRange(bool source,
+                   const std::string& table,
+                   TableKeys& data,
+                   std::size_t bulk,
+                   const DbRecord& from,
+                   const DbRecord& to);
+  bool loadPkBound(const std::string& table, std::size_t offset, TableKeys& into, const DbRecord& from = {});
+  bool loadPkWindow(const std::string& table,
+                    TableKeys& data,
+                    std::size_t bulk,
+                    const DbRecord& after,
+                    const DbRecord& upTo);
   bool query(const std::string& sql, TableData& data);
   bool insertPrepare(const std::string& table);
   bool insertExecute(const std::string& table, const std::unique_ptr<TableRow>& row);
+  bool insertExecute(const std::string& table, const TableData& data, std::size_t from, std::size_t to);
+  bool upsertExecute(const std::string& table,
+                     const TableData& data,
+                     std::size_t from,
+                     std::size_t to,
+                     const strings& fields,
+                     bool replace);
+  bool loadDataExecute(
+      const std::string& table, const TableData& data, std::size_t from, std::size_t to, std::size_t& loaded);
   bool updatePrepare(const std::string& table, const strings& keys, const strings& fields);
   bool updateExecute(const std::string& table, const std::unique_ptr<TableRow>& row);
-  bool deletePrepare(const std::string& table, const strings& keys);
-  bool deleteExecute(const std::string& table, const TableKeys& keys, long index);
-  bool comparePrepare(const std::string& table, const std::size_t bulk);
-  bool selectPrepare(const std::string& table, const strings& keys, const std::size_t bulk);
+  bool deletePrepare(const std::string& table, const strings& keys, const std::size_t bulk);
+  bool deleteExecute(const std::string& table, const TableKeys& keys, TableKeysIterator& iter, std::size_t& deleted);
+  bool comparePrepare(const std::string& table, const std::size_t bulk, bool columns = false);
+  bool rangeChecksum(const std::string& table, const DbRecord& lower, const DbRecord& upper, DbRecord& checksum);
+  bool selectPrepare(const std::string& table, const strings& keys, const std::size_t bulk, const strings& columns = {});
   bool selectExecute(const std::string& table, const TableKeys& keys, TableKeysIterator& iter, TableData& into);
 
 private:
@@ -169,13 +204,63 @@ private:
             const std::unique_ptr<TableRow>& row,
             const int startIndex,
             const int endIndex);
+  bool loadPk(const std::string& ref,
+              const std::string& table,
+              TableKeys& data,
+              std::size_t bulk,
+              const DbRecord& from,
+              const DbRecord& to);
+  bool batchExecute(const std::string& verb,
+                    const std::string& table,
+                    const TableData& data,
+                    std::size_t from,
+                    std::size_t to,
+                    const std::string& suffix);
+  bool keyTablePrepare(const std::string& table, const strings& keys);
+  bool stageKeys(const TableKeys& keys, TableKeysIterator& iter, std::size_t max, std::size_t& staged);
+  bool rangeExecute(std::optional<soci::statement>& stmt,
+                    const std::string& sql,
+                    const TableKeys& keys,
+                    TableKeysIterator& iter,
+                    std::size_t run,
+                    TableData* into);
+  bool loadPkParallel(const std::string& ref, const std::string& table, TableKeys& data, std::size_t bulk);
+  bool loadPkPage(const std::string& table,
+                  TableKeys& data,
+                  std::size_t bulk,
+                  const DbRecord& lower,
+                  const std::string& lowerOp,
+                  const DbRecord& upper,
+                  const std::string& upperOp,
+                  std::size_t& loaded);
+  strings pkColumns(const std::string& table, bool quoted = true) const;
+  std::string md5Expression(const std::string& table) const;
+  static std::string seekCondition(const strings& pk, const std::string& op, char tag = 's');
+  static void bindSeek(soci::statement& stmt, const DbRecord& key);
 
 private:
   const std::shared_ptr<dbsync::Operation> manager;
   const std::shared_ptr<DbMeta> meta;
   std::optional<soci::statement> stmtRead;
   std::optional<soci::statement> stmtWrite;
+  std::optional<soci::statement> stmtBatch;
+  // range statements of the keys runs, prepared on first use
+  std::optional<soci::statement> stmtReadRange;
+  std::optional<soci::statement> stmtWriteRange;
+  std::string readRangeSql;
+  std::string writeRangeSql;
+  // statements joined with the keys temporary table and its key columns source table
+  std::string readJoinSql;
+  std::string writeJoinSql;
+  std::string keyTable;
+  std::optional<soci::statement> stmtStage;
+  std::size_t stageRows = 0;
+  std::string batchSql;
+  std::string clientCharset; // of the session, read on the first LOAD DATA
+  std::string updateTable;
+  std::map<std::string, soci::statement> updateStatements;
   std::size_t readCount;
+  std::size_t deleteCount;
   int keysCount;
 };
 }
@@ -19,34 +19,112 @@
 
 #include <main.h>
 #include <soci/soci.h>
+#include <span>
+#include <string_view>
 
 namespace dbsync {
 
 class TableKeysIterator;
 
+// string key column: the bytes of all the values in a single buffer, value i
+// spans [offsets[i], offsets[i + 1])
+class StringArena {
+public:
+  using value_type = std::string_view;
+  StringArena()
+      : offsets{ 0 } {}
+  void reserve(std::size_t n);
+  void push_back(std::string_view value) {
+    bytes.insert(bytes.end(), value.begin(), value.end());
+    offsets.push_back(bytes.size());
+  }
+  void append(const StringArena& other);
+  std::size_t size() const { return offsets.size() - 1; }
+  std::string_view operator[](std::size_t i) const {
+    return { bytes.data() + offsets[i], offsets[i + 1] - offsets[i] };
+  }
+  const char* data() const { return bytes.data(); }
+  const std::size_t* bounds() const { return offsets.data(); }
+
+private:
+  std::vector<char> bytes;
+  std::vector<std::size_t> offsets;
+};
+
+template <typename... V> struct KeyKernel;
+
+// bitmap of the key flags, scanned a 64 bit word at a time; the count of the
+// set flags is kept up to date
+class KeyFlags {
+public:
+  void resize(std::size_t n) {
+    bits = n;
+    ones = 0;
+    words.assign((n + 63) / 64, 0);
+  }
+  std::size_t size() const { return bits; }
+  bool operator[](std::size_t i) const { return words[i >> 6] >> (i & 63) & 1; }
+  void set(std::size_t i, bool value);
+  void set(std::size_t from, std::size_t to, bool value);
+  void flip();
+  std::size_t count(bool value) const { return value ? ones : bits - ones; }
+  std::size_t next(std::size_t i, bool value) const;
+
+private:
+  std::vector<std::uint64_t> words;
+  std::size_t bits = 0;
+  std::size_t ones = 0;
+};
+
 class TableKeys {
   friend class TableKeysIterator;
+  template <typename... V> friend struct KeyKernel;
 
 public:
-  TableKeys();
+  TableKeys(bool encoded = false, bool digests = false);
+  void reserve(std::size_t rows);
   void loadRow(const soci::row& row);
-  void sort(const char* ref);
+  void append(TableKeys& other);
+  void sort(const char* ref, std::size_t threads = 1);
   std::size_t size() const { return count; }
   bool less(std::size_t i1, const TableKeys& other, std::size_t i2) const;
+  void diff(TableKeys& other);
   const strings& columnNames() const { return names; };
-  void bind(soci::statement& stmt, std::size_t index) const;
+  bool isEncoded() const { return encoded; }
+  bool hasDigests() const { return digests; }
+  void bind(soci::statement& stmt, std::size_t index, DbRecords& values) const;
   std::string rowString(std::size_t index) const;
-  void setFlag(std::size_t index, bool value = true) { flags.at(index) = value; }
+  DbRecord record(std::size_t position) const;
+  DbRecord sortedRecord(std::size_t i) const { return record(index.at(i)); }
+  bool hasStrings() const;
+  std::size_t run(std::size_t i, bool flag, std::size_t max) const { return run(flags, i, flag, max); }
+  std::size_t run(const KeyFlags& bits, std::size_t i, bool flag, std::size_t max) const;
+  void setFlag(std::size_t index, bool value = true) { flags.set(index, value); }
+  void setFlags(std::size_t from, std::size_t to, bool value) { flags.set(from, to, value); }
   void revertFlags() { flags.flip(); }
-  std::size_t size(bool flag) const { return std::count(flags.begin(), flags.end(), flag); };
+  std::size_t nextFlag(std::size_t from, bool value) const { return flags.next(from, value); }
+  void flagChanged() { flags = changed; }
+  std::size_t size(bool flag) const { return flags.count(flag); };
+  const KeyFlags& flagSet() const { return flags; }
   TableKeysIterator iter(bool flag) const;
+  TableKeysIterator iter(bool flag, const KeyFlags& bits) const;
   bool check(std::size_t index, DbRecord record) const;
 
 private:
   void init(const soci::row& row);
+  void grow(std::size_t rows);
   bool less(std::size_t i1, std::size_t i2) const;
   std::partial_ordering compare(std::size_t i1, const TableKeys& other, std::size_t i2) const;
-  void swap(std::size_t i1, std::size_t i2);
+  template <typename F> void dispatch(const TableKeys& other, F&& f) const;
+  bool radixSortable() const;
+  std::uint64_t radixKey(std::size_t column, std::size_t position) const;
+  void radixSort(std::span<std::size_t> range);
+  void sortRange(std::span<std::size_t> range);
+  void sortParallel(std::size_t threads);
+  template <typename C> void mergeRuns(std::vector<std::size_t>& bounds, std::vector<std::size_t>& buffer, C& comp);
+  void encode(const soci::row& row);
+  DbRecord decode(std::size_t position) const;
+  std::pair<const unsigned char*, std::size_t> encodedKey(std::size_t position) const;
 
 private:
   using vI = std::vector<int>;
@@ -54,15 +132,29 @@ private:
   using vULL = std::vector<unsigned long long>;
   using vD = std::vector<double>;
   using vT = std::vector<std::time_t>;
-  using vS = std::vector<std::string>;
+  using vS = StringArena;
   using vect = std::variant<vI, vLL, vULL, vD, vT, vS>;
   using key_type = std::pair<soci::data_type, vect>;
+  // primary key layouts with a specialized comparator
+  enum class Shape { Generic, Int, Long, LongLong, LongString, String };
   std::size_t count;
+  std::size_t expected; // rows estimate, sizes the storage on the first key
+  std::size_t capacity; // rows reserved
   strings names;
   std::vector<std::size_t> index;
   std::vector<key_type> keys;
-  std::vector<bool> flags;
+  KeyFlags flags;
   bool sorted;
+  Shape shape;
+  // optional store of the keys encoded as memcmp comparable byte strings
+  bool encoded;
+  std::size_t width; // encoded key size if fixed, 0 if variable
+  std::vector<unsigned char> store;
+  std::vector<std::size_t> offsets;
+  // optional md5 of the records (16 bytes for each key) and the common keys whose md5 differs
+  bool digests;
+  std::vector<unsigned char> digest;
+  KeyFlags changed;
 };
 
 /*****************************************************************************/
@@ -70,22 +162,25 @@ private:
 class TableKeysIterator {
 public:
 public:
-  TableKeysIterator(const TableKeys& k, std::size_t i)
-      : keys{ k }, flag{ k.flags[i] }, index{ i } {};
+  TableKeysIterator(const TableKeys& k, bool f)
+      : TableKeysIterator{ k, k.flags, f } {};
+  // iterates the keys with flag f in bits, a copy of the flags of k
+  TableKeysIterator(const TableKeys& k, const KeyFlags& b, bool f)
+      : keys{ k }, bits{ b }, flag{ f }, index{ b.next(0, f) } {};
   TableKeysIterator(TableKeysIterator const& other)
-      : keys{ other.keys }, flag{ other.flag }, index{ other.index } {};
+      : keys{ other.keys }, bits{ other.bits }, flag{ other.flag }, index{ other.index } {};
   std::size_t value() const { return index; }
   std::size_t ref() const { return keys.index[index]; }
   bool end() const { return index >= keys.count; }
+  std::size_t run(std::size_t max) const { return keys.run(bits, index, flag, max); }
   TableKeysIterator& operator++() {
-    do {
-      index++;
-    } while(keys.flags[index] != flag && index < keys.count);
+    index = bits.next(index + 1, flag);
     return *this;
   }
 
 private:
   const TableKeys& keys;
+  const KeyFlags& bits;
   const bool flag;
   std::size_t index;
 };
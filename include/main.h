@@ -25,6 +25,7 @@
 #include <boost/optional/optional_io.hpp>
 #include <cassert>
 #include <chrono>
+#include <deque>
 #include <fmt/chrono.h>
 #include <fmt/core.h>
 #include <fmt/ostream.h>
@@ -56,6 +57,7 @@ using strings = std::vector<std::string>;
 using DbValue = std::variant<int, long long, unsigned long long, double, std::time_t, std::string>;
 using DbField = std::pair<soci::data_type, DbValue>;
 using DbRecord = std::vector<DbField>;
+using DbRecords = std::deque<DbRecord>;
 
 void progress(
     log4cxx::LoggerPtr& log, const std::string& table, TimerMs& timer, const char* t, int count, std::size_t size = 0);
@@ -26,6 +26,23 @@ enum Mode { Copy, Sync };
 
 std::ostream& operator<<(std::ostream& stream, const Mode& var);
 
+// how changed records are written: one UPDATE each or multi-row batches
+enum class UpdateMode { Single, Upsert, Replace };
+
+std::ostream& operator<<(std::ostream& stream, const UpdateMode& var);
+
+/*****************************************************************************/
+
+// unit of work of a job: a table or the primary key range [from, to) of a large one
+struct TableChunk {
+  std::string table;
+  DbRecord from;
+  DbRecord to;
+  std::size_t part = 0; // 0 for a whole table
+};
+
+std::ostream& operator<<(std::ostream& stream, const TableChunk& var);
+
 /*****************************************************************************/
 
 class stop_request : public std::runtime_error {
@@ -39,13 +56,30 @@ public:
 struct OperationConfig {
   Mode mode;
   bool update;
+  bool rangeChecksum;
+  bool pkChecksum;
+  UpdateMode updateMode;
+  bool partialUpdate;
+  bool loadData;
+  bool pipeline;
+  bool concurrentPhases;
+  bool stream;
+  bool encodeKeys;
+  bool keyTable;
   bool dryRun;
   strings& tables;
   bool disableBinLog;
   bool noFail;
   std::size_t pkBulk;
+  std::size_t pkJobs;
+  std::size_t sortJobs;
   std::size_t compareBulk;
   std::size_t modifyBulk;
+  std::size_t chunkRows;
+  std::size_t poolThreads;
+  std::size_t deleteBulk;
+  std::size_t insertRows;
+  std::size_t insertBytes;
 };
 
 std::ostream& operator<<(std::ostream& stream, const OperationConfig& var);
@@ -67,26 +101,41 @@ public:
   bool canRun() const { return run.load(); }
   void checkRun() const;
   void stop();
+  void jobEnded(bool ok);
+  bool waitJobs(std::size_t jobs);
   std::size_t rwCount() const { return dbRw.load(); }
   int tablesCount() const { return tables.size(); }
-  std::string tableToProcess();
+  void startPool(std::size_t threads);
+  util::thread::Pool& pool() const { return *tasks; }
+  bool chunkToProcess(TableChunk& chunk);
+  void addChunk(const TableChunk& chunk);
 
 private:
   bool checkMetadataColumns(const std::string& table);
+  std::size_t tableCost(const std::string& table) const;
+  void schedule();
 
 private:
   const OperationConfig& config;
   std::shared_ptr<dbsync::DbMeta> fromDb;
   std::shared_ptr<dbsync::DbMeta> toDb;
   std::set<std::string> tables;
+  std::deque<TableChunk> queue; // tables to process, most expensive first
   log4cxx::LoggerPtr log;
   std::atomic_size_t dbRw;
   std::atomic_bool run;
   std::mutex mutex;
+  std::condition_variable ended;
+  std::size_t endedJobs = 0;
+  std::size_t failedJobs = 0;
+  std::unique_ptr<util::thread::Pool> tasks;
 };
 
 /*****************************************************************************/
 
+// keys positions of the changed records grouped by the set of changed columns
+using ColumnChanges = std::map<strings, std::vector<std::size_t>>;
+
 class OpJob {
 public:
   OpJob(std::shared_ptr<dbsync::Operation> manager) noexcept;
@@ -98,19 +147,40 @@ public:
   bool isRunning() const { return run; }
 
 private:
-  bool execute(const std::string& table);
-  bool executeAdd(const std::string& table, TableKeys& srcKeys, std::size_t total);
+  bool connect();
+  TableKeys newKeys() const;
+  bool execute(const TableChunk& chunk);
+  bool splitTable(const std::string& table, bool& split);
+  bool executeStream(const std::string& table);
+  bool executeKeys(const std::string& table, TableKeys& srcKeys, TableKeys& destKeys);
+  bool executePhases(const std::string& table,
+                     TableKeys& srcKeys,
+                     TableKeys& destKeys,
+                     const std::tuple<std::size_t, std::size_t, std::size_t>& diff);
+  bool executeAdd(const std::string& table, TableKeys& srcKeys, const KeyFlags& flags, std::size_t total);
+  bool executeLoadData(const std::string& table, TableData& srcRecord);
   bool executeUpdate(const std::string& table, TableKeys& srcKeys, std::size_t total);
+  bool compareRanges(const std::string& table, TableKeys& srcKeys);
+  bool compareRecords(const std::string& table, TableKeys& srcKeys, std::size_t total, ColumnChanges& changes);
+  bool updateRecords(const std::string& table, TableKeys& srcKeys, std::size_t total, const strings& columns);
+  bool readBlocks(const std::string& table,
+                  TableKeys& srcKeys,
+                  const KeyFlags& flags,
+                  std::size_t total,
+                  const strings& columns,
+                  const std::function<bool(TableData&)>& write);
   bool executeDelete(const std::string& table, TableKeys& destKeys, std::size_t total);
   std::string buildSqlKeys(const std::string& table) const;
   std::tuple<std::size_t, std::size_t, std::size_t>
   compareKeys(const std::string& table, TableKeys& srcKeys, TableKeys& destKeys);
+  std::size_t batchRows(const TableData& data, std::size_t first) const;
   bool feedback(const std::size_t count, const std::size_t bulk, const std::size_t total) const;
 
 private:
   std::shared_ptr<dbsync::Operation> manager;
   std::unique_ptr<Db> fromDb;
   std::unique_ptr<Db> toDb;
+  std::vector<OpJob> phases; // with option concurrentPhases the update job
   log4cxx::LoggerPtr log;
   bool ret;
   bool run;
@@ -136,6 +206,7 @@ public:
   std::string toString(const strings& names) const;
   DbRecord toRecord() const;
   size_t size() const { return fields.size(); }
+  std::size_t bytes() const;
   void rotate(const int moveCount);
 
 private:
@@ -175,3 +246,4 @@ private:
 
 template <> struct fmt::formatter<dbsync::Mode> : ostream_formatter {};
 template <> struct fmt::formatter<dbsync::OperationConfig> : ostream_formatter {};
+template <> struct fmt::formatter<dbsync::TableChunk> : ostream_formatter {};
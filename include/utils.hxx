@@ -1,9 +1,16 @@
 #pragma once
 
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <sys/resource.h>
+#include <thread>
+#include <vector>
 
 namespace util {
 
@@ -71,6 +78,69 @@ std::ostream& eraseLeft(std::ostream& stream);
 
 }
 
+namespace thread {
+/*****************************************************************************/
+/* fixed size pool of threads running the submitted tasks in order           */
+/*****************************************************************************/
+
+// result of a submitted task, like the future of std::async waits for the task
+// when destroyed so that the task never outlives the data it references
+template <typename R> class Task {
+public:
+  Task() = default;
+  Task(std::future<R>&& f) noexcept
+      : future{ std::move(f) } {}
+  Task(Task&&) = default;
+  Task& operator=(Task&& other) {
+    wait();
+    future = std::move(other.future);
+    return *this;
+  }
+  ~Task() { wait(); }
+  bool valid() const { return future.valid(); }
+  R get() { return future.get(); }
+  void wait() const {
+    if(future.valid())
+      future.wait();
+  }
+
+private:
+  std::future<R> future;
+};
+
+class Pool {
+public:
+  Pool(std::size_t threads);
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+  ~Pool();
+  std::size_t size() const { return workers.size(); }
+  // tasks must not wait for other tasks of the pool
+  template <typename F> Task<std::invoke_result_t<F>> submit(F&& f) {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace_back([task] { (*task)(); });
+    }
+    ready.notify_one();
+    return Task<R>{ std::move(future) };
+  }
+
+private:
+  void work();
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool stopping = false;
+};
+
+}
+
 namespace timer {
 /*****************************************************************************/
 /* timer for processing operation, calculates eta and speed                  */
@@ -15,15 +15,30 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstdio>
+#include <cstring>
 #include <db.h>
+#include <errmsg.h>
+#include <future>
 #include <keys.h>
 #include <operation.h>
+#include <soci/mysql/soci-mysql.h>
 
 namespace dbsync {
 
 const std::string SQL_NULL_STRING{ (const char*)u8"∅" };
 const std::string SQL_MD5_CHECK{ "`#MD5@CHECK#`" };
 
+// minimum estimated rows to split the primary key load between connections
+const std::size_t PK_PARALLEL_ROWS = 1000000;
+
+// minimum consecutive integer keys read or deleted with a range instead of a list
+const std::size_t KEY_RUN = 8;
+
+// session temporary table of the keys to read or delete with option keyTable
+const std::string KEY_TABLE{ "db_sync_keys" };
+const std::size_t KEY_STAGE_ROWS = 1000;
+
 /*****************************************************************************/
 
 DbBase::DbBase(const std::string r)
@@ -43,6 +58,11 @@ void DbBase::transactionCommit() {
   tx->commit();
 }
 
+void DbBase::transactionRollback() {
+  assert(tx.has_value());
+  apply("rollback", [&] { tx->rollback(); });
+}
+
 bool DbBase::apply(const std::string& opDesc, std::function<void(void)> lambda, std::function<void(void)> finally) {
   bool ok = false;
   try {
@@ -85,6 +105,22 @@ bool DbBase::query(const std::string& sql, std::function<void(const soci::row&)>
   });
 }
 
+bool DbBase::query(const std::string& sql,
+                   std::function<void(soci::statement&)> binder,
+                   std::function<void(const soci::row&)> consumer) {
+  return apply(sql, [&] {
+    soci::statement stmt = (session->prepare << sql);
+    binder(stmt);
+    soci::row row;
+    stmt.exchange_for_rowset(soci::into(row));
+    stmt.execute(false);
+    soci::rowset_iterator<soci::row> it(stmt, row);
+    soci::rowset_iterator<soci::row> end;
+    for(; it != end; ++it)
+      consumer(row);
+  });
+}
+
 bool DbBase::exec(const std::string& sql) {
   return apply(sql, [&] { *session << sql; });
 }
@@ -108,11 +144,11 @@ select
 	column_name as "NAME",
 	data_type as "TYPE",
 	is_nullable as "NULLABLE",
-	exists(select * from information_schema.key_column_usage k 
+	coalesce((select k.ordinal_position from information_schema.key_column_usage k 
 		where k.constraint_name = 'primary' 
 		and k.table_schema = c.table_schema 
 		and k.table_name = c.table_name 
-		and k.column_name = c.column_name) as "PK"
+		and k.column_name = c.column_name), 0) as "PK"
 from
 	information_schema.columns c
 where
@@ -121,8 +157,23 @@ where
 ;
 )#" };
 
-bool DbMeta::open(const std::string& h, int p, const std::string& s, const std::string& user, const std::string& pwd) {
+const std::string DbMeta::SQL_ROWS{ R"#(
+select
+	table_rows as "ROWS",
+	data_length as "BYTES"
+from
+	information_schema.tables
+where
+  table_schema = :schema
+	and table_name = :tabella
+;
+)#" };
+
+bool DbMeta::open(
+    const std::string& h, int p, const std::string& s, const std::string& user, const std::string& pwd, bool localInfile) {
   connection = fmt::format("host={} port={} db={} user={} password={}", h, p, s, user, pwd);
+  if(localInfile)
+    connection += " local_infile=1";
   schema = s;
   return DbBase::open(connection);
 }
@@ -138,6 +189,10 @@ bool DbMeta::loadMetadata(std::set<std::string> tables) {
         ColumnInfo ci;
         std::string isNullable;
         int pk;
+        long long rows;
+        long long bytes;
+        soci::indicator rowsIndicator;
+        soci::indicator bytesIndicator;
         soci::statement stInfo = (sex().prepare << SQL_COLUMNS,
                                   soci::use(schema),
                                   soci::use(table),
@@ -145,6 +200,12 @@ bool DbMeta::loadMetadata(std::set<std::string> tables) {
                                   soci::into(ci.type),
                                   soci::into(isNullable),
                                   soci::into(pk));
+        soci::statement stRows
+            = (sex().prepare << SQL_ROWS,
+               soci::use(schema),
+               soci::use(table),
+               soci::into(rows, rowsIndicator),
+               soci::into(bytes, bytesIndicator));
         for(auto& t : tables) {
           table = t;
           TableInfo ti;
@@ -153,9 +214,17 @@ bool DbMeta::loadMetadata(std::set<std::string> tables) {
             do {
               ci.nullable = ba::iequals(isNullable, "yes");
               ci.primaryKey = pk > 0;
+              ci.keyPosition = pk;
               ti.columns.push_back(ci);
             } while(stInfo.fetch());
           }
+          // rows estimate
+          if(stRows.execute(true)) {
+            if(rowsIndicator == soci::i_ok && rows > 0)
+              ti.rows = rows;
+            if(bytesIndicator == soci::i_ok && bytes > 0)
+              ti.bytes = bytes;
+          }
           //
           LOG4CXX_DEBUG_FMT(log, "{} `{}` ", ref, table);
           map.emplace(table, std::move(ti));
@@ -174,38 +243,129 @@ void DbMeta::logTableInfo() const {
 
 /*****************************************************************************/
 
+// primary key columns in the index order, so that ORDER BY and seek conditions use it
+strings Db::pkColumns(const std::string& table, bool quoted) const {
+  auto& tm = meta->metadata(table);
+  std::vector<const ColumnInfo*> columns;
+  for(auto& column : tm.columns)
+    if(column.primaryKey)
+      columns.push_back(&column);
+  std::stable_sort(columns.begin(), columns.end(), [](const ColumnInfo* a, const ColumnInfo* b) {
+    return a->keyPosition < b->keyPosition;
+  });
+  strings pk;
+  for(auto column : columns)
+    pk.push_back(quoted ? fmt::format("`{}`", column->name) : column->name);
+  return pk;
+}
+
 bool Db::loadPk(bool source, const std::string& table, TableKeys& data, std::size_t bulk) {
-  auto tm = meta->metadata(table);
   std::string ref = source ? "source" : "target";
-  std::string desc;
-  strings pk;
-  for(int i = 0; i < tm.columns.size(); i++) {
-    if(tm.columns[i].primaryKey) {
-      pk.push_back(fmt::format("`{}`", tm.columns[i].name));
+  std::size_t parts = manager->configuration().pkJobs;
+  if(parts > 1 && meta->metadata(table).rows >= PK_PARALLEL_ROWS)
+    return loadPkParallel(ref, table, data, bulk);
+  data.reserve(meta->metadata(table).rows);
+  return loadPk(ref, table, data, bulk, {}, {});
+}
+
+bool Db::loadPkParallel(const std::string& ref, const std::string& table, TableKeys& data, std::size_t bulk) {
+  std::size_t parts = manager->configuration().pkJobs;
+  std::size_t rows = meta->metadata(table).rows;
+  // one connection for each range, this one reads the first
+  std::vector<std::unique_ptr<Db>> dbs;
+  for(std::size_t i = 1; i < parts; i++) {
+    auto& db = dbs.emplace_back(std::make_unique<Db>(manager, meta));
+    if(!db->open()) {
+      LOG4CXX_WARN_FMT(log, "`{}` {} parallel key loading disabled: {}", table, ref, db->lastError());
+      return loadPk(ref, table, data, bulk, {}, {});
     }
   }
-  std::stringstream sqlKeys;
-  std::stringstream sqlWhere;
-  sqlKeys << "SELECT " << ba::join(pk, ",");
-  /*
-  if(data.hasUpdateCheck())
-    sqlKeys << ",MD5(CONCAT(" << ba::join(fields, ",") << ")) AS " << SQL_MD5_CHECK;
-  */
-  sqlKeys << " FROM `" << table << '`';
-  std::string select = sqlKeys.str();
+  // each connection samples the lower bound of its range from the primary key index, then
+  // loads the range as soon as the next bound is known: the samples run in parallel and the
+  // first ranges start loading while the farther samples are still scanning the index
+  LOG4CXX_DEBUG_FMT(log, "`{}` {} key loading split in {} ranges", table, ref, parts);
+  std::vector<TableKeys> samples(parts);
+  std::vector<std::promise<bool>> sampled(parts);
+  std::vector<TableKeys> loaded(parts, TableKeys{ data.isEncoded(), data.hasDigests() });
+  for(auto& keys : loaded)
+    keys.reserve(rows / parts);
+  std::vector<std::future<bool>> loading;
+  for(std::size_t i = 0; i < parts; i++)
+    loading.emplace_back(std::async(std::launch::async, [&, i] {
+      Db& db = i == 0 ? *this : *dbs[i - 1];
+      DbRecord lower;
+      if(i > 0) {
+        bool ok = db.loadPkBound(table, rows / parts * i, samples[i]);
+        sampled[i].set_value(ok);
+        // estimate may exceed the real rows count: the previous range reads up to the end
+        if(!ok || samples[i].size() == 0)
+          return ok;
+        lower = samples[i].record(0);
+      }
+      DbRecord upper;
+      if(i + 1 < parts) {
+        if(!sampled[i + 1].get_future().get())
+          return false;
+        if(samples[i + 1].size() > 0)
+          upper = samples[i + 1].record(0);
+      }
+      auto desc = fmt::format("{} [{}/{}]", ref, i + 1, parts);
+      return db.loadPk(desc, table, loaded[i], bulk, lower, upper);
+    }));
+  bool ok = true;
+  for(auto& f : loading)
+    ok &= f.get();
+  if(!ok)
+    return false;
+  // ranges are disjoint and ordered, join them in the first one sized for all
+  std::size_t total = 0;
+  for(auto& keys : loaded)
+    total += keys.size();
+  loaded[0].reserve(total);
+  for(auto& keys : loaded)
+    data.append(keys);
+  return true;
+}
+
+// the key at offset in the primary key order, counting from the key from if provided
+bool Db::loadPkBound(const std::string& table, std::size_t offset, TableKeys& into, const DbRecord& from) {
+  strings pk = pkColumns(table);
+  std::string where = from.empty() ? "" : " WHERE " + seekCondition(pk, ">=");
+  std::string sql = fmt::format(
+      "SELECT {0} FROM `{1}`{2} ORDER BY {0} LIMIT 1 OFFSET {3}", ba::join(pk, ","), table, where, offset);
+  into.reserve(1);
+  return DbBase::query(
+      sql,
+      [&](soci::statement& stmt) {
+        if(!from.empty())
+          bindSeek(stmt, from);
+      },
+      [&](const soci::row& row) { into.loadRow(row); });
+}
+
+bool Db::loadPkRange(
+    bool source, const std::string& table, TableKeys& data, std::size_t bulk, const DbRecord& from, const DbRecord& to) {
+  return loadPk(source ? "source" : "target", table, data, bulk, from, to);
+}
+
+bool Db::loadPk(const std::string& ref,
+                const std::string& table,
+                TableKeys& data,
+                std::size_t bulk,
+                const DbRecord& from,
+                const DbRecord& to) {
+  std::string desc;
   TimerMs timer;
   bool ok = true;
   std::size_t loaded = bulk;
   desc = ref + " key loading";
   while(ok && loaded == bulk) {
     progress(log, table, timer, desc.c_str(), data.size());
-    std::string sql = fmt::format("{} LIMIT {} OFFSET {}", select, bulk, data.size());
-    loaded = 0;
-    ok = DbBase::query(sql, [&](const soci::row& row) {
-      data.loadRow(row);
-      loaded++;
-      manager->checkRun();
-    });
+    // keyset pagination: each page restarts from the last key loaded
+    if(data.size() == 0)
+      ok = loadPkPage(table, data, bulk, from, ">=", to, "<", loaded);
+    else
+      ok = loadPkPage(table, data, bulk, data.record(data.size() - 1), ">", to, "<", loaded);
   };
   desc = ref + " key loaded";
   progress(log, table, timer, desc.c_str(), data.size());
@@ -213,6 +373,52 @@ bool Db::loadPk(bool source, const std::string& table, TableKeys& data, std::siz
   return ok;
 };
 
+bool Db::loadPkWindow(
+    const std::string& table, TableKeys& data, std::size_t bulk, const DbRecord& after, const DbRecord& upTo) {
+  std::size_t loaded;
+  // a window of a small table holds at most its rows
+  data.reserve(data.size() + std::min(meta->metadata(table).rows, bulk));
+  return loadPkPage(table, data, bulk, after, ">", upTo, "<=", loaded);
+}
+
+bool Db::loadPkPage(const std::string& table,
+                    TableKeys& data,
+                    std::size_t bulk,
+                    const DbRecord& lower,
+                    const std::string& lowerOp,
+                    const DbRecord& upper,
+                    const std::string& upperOp,
+                    std::size_t& loaded) {
+  strings pk = pkColumns(table);
+  std::stringstream sql;
+  sql << "SELECT " << ba::join(pk, ",");
+  if(data.hasDigests())
+    sql << ",UNHEX(" << md5Expression(table) << ") AS " << SQL_MD5_CHECK;
+  sql << " FROM `" << table << '`';
+  strings where;
+  if(!lower.empty())
+    where.push_back(seekCondition(pk, lowerOp, 's'));
+  if(!upper.empty())
+    where.push_back(seekCondition(pk, upperOp, 'u'));
+  if(!where.empty())
+    sql << " WHERE " << ba::join(where, " AND ");
+  sql << " ORDER BY " << ba::join(pk, ",") << " LIMIT " << bulk;
+  loaded = 0;
+  return DbBase::query(
+      sql.str(),
+      [&](soci::statement& stmt) {
+        if(!lower.empty())
+          bindSeek(stmt, lower);
+        if(!upper.empty())
+          bindSeek(stmt, upper);
+      },
+      [&](const soci::row& row) {
+        data.loadRow(row);
+        loaded++;
+        manager->checkRun();
+      });
+}
+
 bool Db::query(const std::string& sql, TableData& data) {
   return DbBase::query(sql, [&](const soci::row& row) { data.loadRow(row); });
 }
@@ -239,8 +445,178 @@ bool Db::insertExecute(const std::string& table, const std::unique_ptr<TableRow>
       std::bind(&soci::statement::bind_clean_up, *stmtWrite));
 }
 
+// multi-row insert of the records [from, to)
+bool Db::insertExecute(const std::string& table, const TableData& data, std::size_t from, std::size_t to) {
+  return batchExecute("INSERT", table, data, from, to, "");
+}
+
+// multi-row update of the records [from, to) with REPLACE or INSERT ... ON DUPLICATE KEY UPDATE fields
+bool Db::upsertExecute(
+    const std::string& table, const TableData& data, std::size_t from, std::size_t to, const strings& fields, bool replace) {
+  if(replace)
+    return batchExecute("REPLACE", table, data, from, to, "");
+  strings values;
+  for(auto& field : fields)
+    values.push_back(fmt::format("`{0}`=VALUES(`{0}`)", field));
+  return batchExecute("INSERT", table, data, from, to, " ON DUPLICATE KEY UPDATE " + ba::join(values, ","));
+}
+
+bool Db::batchExecute(const std::string& verb,
+                      const std::string& table,
+                      const TableData& data,
+                      std::size_t from,
+                      std::size_t to,
+                      const std::string& suffix) {
+  assert(from < to && to <= data.size());
+  const std::size_t columns = data.columnNames().size();
+  std::stringstream s;
+  s << verb << " INTO `" << table << "` (`" << ba::join(data.columnNames(), "`,`") << "`) VALUES";
+  for(std::size_t r = 0; r < to - from; r++) {
+    s << (r > 0 ? ",(" : "(");
+    for(std::size_t c = 0; c < columns; c++)
+      s << (c > 0 ? "," : "") << ":v" << c << '_' << r;
+    s << ')';
+  }
+  s << suffix;
+  std::string sql = s.str();
+  return apply(
+      fmt::format("exec multi-row {}", verb),
+      [&] {
+        // batches of the same size share the statement
+        if(sql != batchSql) {
+          stmtBatch = (sex().prepare << sql);
+          batchSql = sql;
+        }
+        for(std::size_t r = from; r < to; r++)
+          bind(stmtBatch, data.at(r), 0, columns);
+        stmtBatch->execute(true);
+      },
+      [&] {
+        if(stmtBatch.has_value())
+          stmtBatch->bind_clean_up();
+      });
+}
+
+namespace {
+
+// LOAD DATA text format: tab separated fields, one record for each line,
+// NULL as \N and backslash escapes for the separators
+void infileValue(std::string& out, const Field& field) {
+  if(field.isNull()) {
+    out += "\\N";
+    return;
+  }
+  switch(field.type()) {
+  case soci::dt_string:
+  case soci::dt_xml:
+  case soci::dt_blob:
+  case soci::dt_date:
+    for(char c : field.asString()) {
+      switch(c) {
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\0':
+        out += "\\0";
+        break;
+      default:
+        out += c;
+      }
+    }
+    break;
+  case soci::dt_double:
+    out += fmt::format("{}", field.asDouble());
+    break;
+  default:
+    out += field.toString();
+    break;
+  }
+}
+
+// records are formatted one at a time while the client library reads them
+struct InfileReader {
+  const TableData& data;
+  std::size_t row;
+  const std::size_t end;
+  std::string line;
+  std::size_t offset;
+};
+
+int infileInit(void** ptr, const char*, void* userdata) {
+  *ptr = userdata;
+  return 0;
+}
+
+int infileRead(void* ptr, char* buf, unsigned int length) {
+  auto& reader = *static_cast<InfileReader*>(ptr);
+  unsigned int written = 0;
+  while(written < length) {
+    if(reader.offset == reader.line.size()) {
+      if(reader.row == reader.end)
+        break;
+      const auto& record = reader.data.at(reader.row++);
+      reader.line.clear();
+      reader.offset = 0;
+      for(std::size_t i = 0; i < record->size(); i++) {
+        if(i > 0)
+          reader.line += '\t';
+        infileValue(reader.line, *record->at(i));
+      }
+      reader.line += '\n';
+    }
+    std::size_t n = std::min<std::size_t>(length - written, reader.line.size() - reader.offset);
+    std::memcpy(buf + written, reader.line.data() + reader.offset, n);
+    reader.offset += n;
+    written += n;
+  }
+  return written;
+}
+
+void infileEnd(void*) {}
+
+int infileError(void*, char* msg, unsigned int length) {
+  std::snprintf(msg, length, "db-sync records reader error");
+  return CR_UNKNOWN_ERROR;
+}
+
+}
+
+// bulk load of the records [from, to) with LOAD DATA LOCAL INFILE fed from memory
+bool Db::loadDataExecute(
+    const std::string& table, const TableData& data, std::size_t from, std::size_t to, std::size_t& loaded) {
+  assert(from < to && to <= data.size());
+  // the fields hold the text as received by the client, the server converts it to the columns charset
+  if(clientCharset.empty())
+    if(!apply("client charset", [&] { sex() << "SELECT @@character_set_client", soci::into(clientCharset); }))
+      return false;
+  std::string sql = fmt::format(R"(LOAD DATA LOCAL INFILE 'db-sync' INTO TABLE `{}` CHARACTER SET {} )"
+                                R"(FIELDS TERMINATED BY '\t' ESCAPED BY '\\' LINES TERMINATED BY '\n' (`{}`))",
+                                table,
+                                clientCharset,
+                                ba::join(data.columnNames(), "`,`"));
+  MYSQL* conn = static_cast<soci::mysql_session_backend*>(sex().get_backend())->conn_;
+  InfileReader reader{ .data = data, .row = from, .end = to, .line = {}, .offset = 0 };
+  loaded = 0;
+  return apply(
+      "exec load data",
+      [&] {
+        mysql_set_local_infile_handler(conn, infileInit, infileRead, infileEnd, infileError, &reader);
+        sex() << sql;
+        // with LOCAL duplicate keys and conversion errors are warnings: records are skipped
+        loaded = mysql_affected_rows(conn);
+      },
+      [&] { mysql_set_local_infile_default(conn); });
+}
+
 bool Db::updatePrepare(const std::string& table, const strings& keys, const strings& fields) {
-  assert(meta->metadata(table).columns.size() == fields.size());
+  assert(fields.size() > keys.size());
+  assert(meta->metadata(table).columns.size() >= fields.size());
   keysCount = keys.size();
   std::stringstream s;
   s << "UPDATE `" << table << "` SET `" << fields[keysCount] << "`=:v0";
@@ -250,11 +626,23 @@ bool Db::updatePrepare(const std::string& table, const strings& keys, const stri
   for(int i = 1; i < keysCount; i++)
     s << " AND `" << keys[i] << "`=:k" << i;
   std::string sql = s.str();
-  return apply(sql, [&] { stmtWrite = (sex().prepare << sql); });
+  // statements are cached for each set of updated fields of the table
+  if(table != updateTable) {
+    updateStatements.clear();
+    updateTable = table;
+  }
+  if(auto it = updateStatements.find(sql); it != updateStatements.end()) {
+    stmtWrite = it->second;
+    return true;
+  }
+  return apply(sql, [&] {
+    stmtWrite = (sex().prepare << sql);
+    updateStatements.emplace(sql, *stmtWrite);
+  });
 }
 
 bool Db::updateExecute(const std::string& table, const std::unique_ptr<TableRow>& row) {
-  assert(meta->metadata(table).columns.size() == row->size());
+  assert(meta->metadata(table).columns.size() >= row->size());
   assert(stmtWrite.has_value());
   row->rotate(keysCount);
   return apply(
@@ -266,49 +654,96 @@ bool Db::updateExecute(const std::string& table, const std::unique_ptr<TableRow>
       std::bind(&soci::statement::bind_clean_up, *stmtWrite));
 }
 
-bool Db::deletePrepare(const std::string& table, const strings& keys) {
+bool Db::deletePrepare(const std::string& table, const strings& keys, const std::size_t bulk) {
+  assert(bulk > 0);
   keysCount = keys.size();
   assert(keysCount > 0);
+  deleteCount = bulk;
+  // used by single column keys only
+  writeRangeSql = fmt::format("DELETE FROM `{}` WHERE `{}` BETWEEN :s AND :u", table, keys[0]);
+  stmtWriteRange.reset();
+  if(manager->configuration().keyTable) {
+    writeJoinSql =
+        fmt::format("DELETE `{0}` FROM `{0}` JOIN `{1}` USING (`{2}`)", table, KEY_TABLE, ba::join(keys, "`,`"));
+    return keyTablePrepare(table, keys);
+  }
   std::stringstream s;
-  s << "DELETE FROM `" << table << "` WHERE `" << keys[0] << "`=:v0";
-  for(int i = 1; i < keysCount; i++)
-    s << " AND `" << keys[i] << "`=:v" << i;
+  s << "DELETE FROM `" << table << "` WHERE (`" << ba::join(keys, "`,`") << "`) IN (";
+  for(int b = 0; b < bulk; b++) {
+    if(b > 0)
+      s << ',';
+    s << "(:k0_" << b;
+    for(int i = 1; i < keysCount; i++)
+      s << ",:k" << i << '_' << b;
+    s << ')';
+  }
+  s << ')';
   std::string sql = s.str();
   return apply(sql, [&] { stmtWrite = (sex().prepare << sql); });
 }
 
-bool Db::deleteExecute(const std::string& table, const TableKeys& keys, long index) {
+bool Db::deleteExecute(const std::string& table, const TableKeys& keys, TableKeysIterator& iter, std::size_t& deleted) {
+  static const std::unique_ptr<TableRow> emptyRow;
+  deleted = iter.run(deleteCount);
+  if(deleted >= KEY_RUN)
+    return rangeExecute(stmtWriteRange, writeRangeSql, keys, iter, deleted, nullptr);
+  if(manager->configuration().keyTable)
+    return stageKeys(keys, iter, deleteCount, deleted) && exec(writeJoinSql);
   assert(stmtWrite.has_value());
+  DbRecords values;
+  deleted = 0;
   return apply(
       "exec prepared delete",
       [&] {
-        LOG4CXX_TRACE_FMT(log, "delete bind [{}] {}", index, keys.rowString(index));
-        keys.bind(*stmtWrite, index);
+        int count = 0;
+        // stops at a run of keys, deleted by the next call with a range (with a bulk
+        // smaller than a run, the run is listed: at least one key is always consumed)
+        while(count < deleteCount && !iter.end() && (count == 0 || iter.run(KEY_RUN) < KEY_RUN)) {
+          LOG4CXX_TRACE_FMT(log, "delete bind [{}] {}", iter.value(), keys.rowString(iter.value()));
+          keys.bind(*stmtWrite, iter.value(), values);
+          ++iter;
+          count++;
+        }
+        deleted = count;
+        // unused placeholders are NULL and match no record
+        for(; count < deleteCount; count++)
+          bind(stmtWrite, emptyRow, 0, keysCount);
         stmtWrite->execute(true);
       },
       std::bind(&soci::statement::bind_clean_up, *stmtWrite));
 }
 
-bool Db::comparePrepare(const std::string& table, const std::size_t bulk) {
+bool Db::comparePrepare(const std::string& table, const std::size_t bulk, bool columns) {
   assert(bulk > 0);
   readCount = bulk;
   auto tm = meta->metadata(table);
-  strings pk;
-  strings fields;
+  strings pk = pkColumns(table);
+  strings crc;
   strings order;
-  int o = 1;
-  for(int i = 0; i < tm.columns.size(); i++) {
-    if(tm.columns[i].primaryKey) {
-      pk.push_back(fmt::format("`{}`", tm.columns[i].name));
-      order.push_back(std::to_string(o++));
-    } else {
-      fields.push_back(fmt::format("COALESCE(`{}`,'{}')", tm.columns[i].name, SQL_NULL_STRING));
-    }
-  }
+  for(std::size_t i = 1; i <= pk.size(); i++)
+    order.push_back(std::to_string(i));
+  if(columns)
+    for(auto& column : tm.columns)
+      if(!column.primaryKey)
+        // named as the column to find which ones changed
+        crc.push_back(fmt::format("CRC32(COALESCE(`{0}`,'{1}')) AS `{0}`", column.name, SQL_NULL_STRING));
   keysCount = pk.size();
   std::stringstream s;
-  s << "SELECT " << ba::join(pk, ",") << ",MD5(CONCAT(" << ba::join(fields, ",") << ")) AS " << SQL_MD5_CHECK;
-  s << " FROM `" << table << "` WHERE (" << ba::join(pk, ",") << ") IN (";
+  s << "SELECT " << ba::join(pk, ",");
+  if(!crc.empty())
+    s << ',' << ba::join(crc, ",");
+  s << ',' << md5Expression(table) << " AS " << SQL_MD5_CHECK;
+  s << " FROM `" << table << '`';
+  // used by single column keys only
+  readRangeSql = fmt::format("{} WHERE {} BETWEEN :s AND :u ORDER BY 1", s.str(), pk[0]);
+  stmtReadRange.reset();
+  if(manager->configuration().keyTable) {
+    strings keys = pkColumns(table, false);
+    readJoinSql = fmt::format(
+        "{} JOIN `{}` USING ({}) ORDER BY {}", s.str(), KEY_TABLE, ba::join(pk, ","), ba::join(order, ","));
+    return keyTablePrepare(table, keys);
+  }
+  s << " WHERE (" << ba::join(pk, ",") << ") IN (";
   for(int b = 0; b < bulk; b++) {
     if(b > 0)
       s << ',';
@@ -322,13 +757,64 @@ bool Db::comparePrepare(const std::string& table, const std::size_t bulk) {
   return apply(sql, [&] { stmtRead = (sex().prepare << sql); });
 }
 
-bool Db::selectPrepare(const std::string& table, const strings& keys, const std::size_t bulk) {
+// md5 of the concatenation of the non key fields
+std::string Db::md5Expression(const std::string& table) const {
+  strings fields;
+  for(auto& column : meta->metadata(table).columns)
+    if(!column.primaryKey)
+      fields.push_back(fmt::format("COALESCE(`{}`,'{}')", column.name, SQL_NULL_STRING));
+  return fmt::format("MD5(CONCAT({}))", ba::join(fields, ","));
+}
+
+// row count and xor of the rows hashes with primary key in [lower, upper]
+bool Db::rangeChecksum(const std::string& table, const DbRecord& lower, const DbRecord& upper, DbRecord& checksum) {
+  auto tm = meta->metadata(table);
+  strings pk = pkColumns(table);
+  // the key is hashed with the fields, so that equal rows do not cancel out
+  strings fields{ pk };
+  for(auto& column : tm.columns)
+    if(!column.primaryKey)
+      fields.push_back(fmt::format("COALESCE(`{}`,'{}')", column.name, SQL_NULL_STRING));
+  std::string sql = fmt::format(
+      "SELECT COUNT(*),BIT_XOR(CAST(CONV(LEFT(MD5(CONCAT_WS('|',{})),16),16,10) AS UNSIGNED)) FROM `{}` WHERE {} AND {}",
+      ba::join(fields, ","),
+      table,
+      seekCondition(pk, ">=", 's'),
+      seekCondition(pk, "<=", 'u'));
+  checksum.clear();
+  return DbBase::query(
+      sql,
+      [&](soci::statement& stmt) {
+        bindSeek(stmt, lower);
+        bindSeek(stmt, upper);
+      },
+      [&](const soci::row& row) {
+        for(std::size_t i = 0; i < row.size(); i++) {
+          Field field{ row, i };
+          checksum.emplace_back(std::make_pair(field.type(), field.asVariant()));
+        }
+      });
+}
+
+bool Db::selectPrepare(const std::string& table, const strings& keys, const std::size_t bulk, const strings& columns) {
   assert(bulk > 0);
   assert(keys.size() > 0);
   keysCount = keys.size();
   readCount = bulk;
   std::stringstream s;
-  s << "SELECT * FROM `" << table << "` WHERE (`" << keys[0] << '`';
+  if(columns.empty())
+    s << "SELECT `" << table << "`.*";
+  else
+    s << "SELECT `" << ba::join(keys, "`,`") << "`,`" << ba::join(columns, "`,`") << '`';
+  s << " FROM `" << table << '`';
+  // used by single column keys only
+  readRangeSql = fmt::format("{} WHERE `{}` BETWEEN :s AND :u", s.str(), keys[0]);
+  stmtReadRange.reset();
+  if(manager->configuration().keyTable) {
+    readJoinSql = fmt::format("{} JOIN `{}` USING (`{}`)", s.str(), KEY_TABLE, ba::join(keys, "`,`"));
+    return keyTablePrepare(table, keys);
+  }
+  s << " WHERE (`" << keys[0] << '`';
   for(int i = 1; i < keysCount; i++)
     s << ",`" << keys[i] << '`';
   s << ") IN (";
@@ -347,14 +833,27 @@ bool Db::selectPrepare(const std::string& table, const strings& keys, const std:
 
 bool Db::selectExecute(const std::string& table, const TableKeys& keys, TableKeysIterator& iter, TableData& into) {
   static const std::unique_ptr<TableRow> emptyRow;
+  std::size_t run = iter.run(readCount);
+  if(run >= KEY_RUN)
+    return rangeExecute(stmtReadRange, readRangeSql, keys, iter, run, &into);
+  if(manager->configuration().keyTable) {
+    std::size_t staged;
+    return stageKeys(keys, iter, readCount, staged) && DbBase::query(readJoinSql, [&](const soci::row& row) {
+             into.loadRow(row);
+             manager->checkRun();
+           });
+  }
   assert(stmtRead.has_value());
+  DbRecords values;
   return apply(
       "exec prepared select",
       [&] {
         int count = 0;
-        while(count < readCount && !iter.end()) {
+        // stops at a run of keys, read by the next call with a range (with a bulk
+        // smaller than a run, the run is listed: at least one key is always consumed)
+        while(count < readCount && !iter.end() && (count == 0 || iter.run(KEY_RUN) < KEY_RUN)) {
           LOG4CXX_TRACE_FMT(log, "select bind [{}] {}", iter.value(), keys.rowString(iter.value()));
-          keys.bind(*stmtRead, iter.value());
+          keys.bind(*stmtRead, iter.value(), values);
           ++iter;
           count++;
         }
@@ -373,6 +872,134 @@ bool Db::selectExecute(const std::string& table, const TableKeys& keys, TableKey
       std::bind(&soci::statement::bind_clean_up, *stmtRead));
 }
 
+// (re)creates the session temporary table with the primary key columns of table
+bool Db::keyTablePrepare(const std::string& table, const strings& keys) {
+  if(table == keyTable)
+    return true;
+  std::string columns = fmt::format("`{}`", ba::join(keys, "`,`"));
+  keyTable.clear();
+  stmtStage.reset();
+  stageRows = 0;
+  if(!exec(fmt::format("DROP TEMPORARY TABLE IF EXISTS `{}`", KEY_TABLE)))
+    return false;
+  // same types and collation of the source columns
+  auto sql = fmt::format(
+      "CREATE TEMPORARY TABLE `{0}` (PRIMARY KEY ({1})) SELECT {1} FROM `{2}` LIMIT 0", KEY_TABLE, columns, table);
+  if(!exec(sql))
+    return false;
+  keyTable = table;
+  return true;
+}
+
+// replaces the content of the keys table with the keys from iter (at most max, at least one),
+// stopping at a run of keys that the next call handles with a range
+bool Db::stageKeys(const TableKeys& keys, TableKeysIterator& iter, std::size_t max, std::size_t& staged) {
+  assert(!keyTable.empty());
+  std::vector<std::size_t> positions;
+  for(; positions.size() < max && !iter.end() && (positions.empty() || iter.run(KEY_RUN) < KEY_RUN); ++iter)
+    positions.push_back(iter.value());
+  staged = positions.size();
+  if(!exec(fmt::format("DELETE FROM `{}`", KEY_TABLE)))
+    return false;
+  for(std::size_t from = 0; from < positions.size(); from += KEY_STAGE_ROWS) {
+    std::size_t rows = std::min(KEY_STAGE_ROWS, positions.size() - from);
+    DbRecords values;
+    bool inserted = apply(
+        "exec stage keys",
+        [&] {
+          // full chunks share the statement, only the last one is prepared again
+          if(rows != stageRows) {
+            std::stringstream s;
+            s << "INSERT INTO `" << KEY_TABLE << "` VALUES";
+            for(std::size_t r = 0; r < rows; r++) {
+              s << (r > 0 ? ",(" : "(");
+              for(int i = 0; i < keysCount; i++)
+                s << (i > 0 ? "," : "") << ":k" << i << '_' << r;
+              s << ')';
+            }
+            stmtStage = (sex().prepare << s.str());
+            stageRows = rows;
+          }
+          for(std::size_t r = from; r < from + rows; r++)
+            keys.bind(*stmtStage, positions[r], values);
+          stmtStage->execute(true);
+        },
+        [&] {
+          if(stmtStage.has_value())
+            stmtStage->bind_clean_up();
+        });
+    if(!inserted)
+      return false;
+  }
+  return true;
+}
+
+// the run of consecutive keys from iter with a BETWEEN statement, a select if into is provided
+bool Db::rangeExecute(std::optional<soci::statement>& stmt,
+                      const std::string& sql,
+                      const TableKeys& keys,
+                      TableKeysIterator& iter,
+                      std::size_t run,
+                      TableData* into) {
+  const DbRecord lower = keys.sortedRecord(iter.value());
+  const DbRecord upper = keys.sortedRecord(iter.value() + run - 1);
+  return apply(
+      "exec prepared range",
+      [&] {
+        if(!stmt.has_value())
+          stmt = (sex().prepare << sql);
+        LOG4CXX_TRACE_FMT(log, "range bind [{}] {}- {}", run, keys.rowString(iter.value()), keys.rowString(iter.value() + run - 1));
+        for(std::size_t i = 0; i < run; i++)
+          ++iter;
+        bindSeek(*stmt, lower);
+        bindSeek(*stmt, upper);
+        if(!into) {
+          stmt->execute(true);
+          return;
+        }
+        soci::row row;
+        stmt->exchange_for_rowset(soci::into(row));
+        stmt->execute(false);
+        soci::rowset_iterator<soci::row> it(*stmt, row);
+        soci::rowset_iterator<soci::row> end;
+        for(; it != end; ++it) {
+          into->loadRow(row);
+          manager->checkRun();
+        }
+      },
+      [&] {
+        if(stmt.has_value())
+          stmt->bind_clean_up();
+      });
+}
+
+// row comparison expanded as (k0 < v0) OR (k0 = v0 AND k1 < v1) OR ... (k0 = v0 AND ... kn op vn)
+// so that the optimizer can use a range scan on the primary key; only the last column
+// term may be inclusive, the others use the strict operator
+std::string Db::seekCondition(const strings& pk, const std::string& op, char tag) {
+  assert(!pk.empty());
+  assert(op == "<" || op == "<=" || op == ">" || op == ">=");
+  const std::string strict = op.substr(0, 1);
+  strings terms;
+  for(std::size_t c = 0; c < pk.size(); c++) {
+    std::stringstream s;
+    s << '(';
+    for(std::size_t i = 0; i < c; i++)
+      s << pk[i] << "=:" << tag << c << '_' << i << " AND ";
+    s << pk[c] << (c + 1 < pk.size() ? strict : op) << ':' << tag << c << '_' << c << ')';
+    terms.push_back(s.str());
+  }
+  return fmt::format("({})", ba::join(terms, " OR "));
+}
+
+// binds the key values in the order of the placeholders of seekCondition
+void Db::bindSeek(soci::statement& stmt, const DbRecord& key) {
+  for(std::size_t c = 0; c < key.size(); c++)
+    for(std::size_t i = 0; i <= c; i++)
+      std::visit([&stmt](const auto& v) { stmt.exchange(soci::use(v)); }, key[i].second);
+  stmt.define_and_bind();
+}
+
 void Db::bind(std::optional<soci::statement>& stmt,
               const std::unique_ptr<TableRow>& row,
               const int startIndex,
@@ -519,7 +1146,7 @@ DbValue Field::asVariant() const {
 /*****************************************************************************/
 
 std::ostream& operator<<(std::ostream& stream, const TableInfo& var) {
-  return stream << "[columns: " << var.columns.size() << "]";
+  return stream << "[columns: " << var.columns.size() << "] [rows: ~" << var.rows << "] [bytes: ~" << var.bytes << "]";
 }
 
 std::ostream& operator<<(std::ostream& stream, const ColumnInfo& var) {
@@ -527,7 +1154,7 @@ std::ostream& operator<<(std::ostream& stream, const ColumnInfo& var) {
   if(var.nullable)
     stream << " nullable";
   if(var.primaryKey)
-    stream << " primary key";
+    stream << " primary key " << var.keyPosition;
   return stream;
 }
 }
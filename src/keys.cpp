@@ -15,80 +15,282 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <array>
+#include <bit>
+#include <cstring>
+#include <endian.h>
 #include <execution>
+#include <future>
 #include <keys.h>
+#include <span>
 
 namespace dbsync {
 
-const std::size_t RESERVE = 10000000;
+// keys reserved without a rows estimate, and minimum growth step
+const std::size_t MIN_RESERVE = 1024;
+// minimum keys sorted by each thread
+const std::size_t SORT_CHUNK = 100000;
+// size of a record md5 loaded with the keys
+const std::size_t DIGEST = 16;
 
 auto log = log4cxx::Logger::getLogger("keys");
 
-TableKeys::TableKeys()
-    : count{ 0 }, sorted(true) {}
+// encoded keys: big endian integers with the sign bit flipped, strings with
+// 0x00 escaped as 0x00 0xFF and terminated by 0x00 0x00
+const std::uint32_t SIGN32 = 0x80000000u;
+const std::uint64_t SIGN64 = 0x8000000000000000ull;
 
-TableKeysIterator TableKeys::iter(bool flag) const {
-  std::size_t index = 0;
-  while(flags[index] != flag && index < count)
-    index++;
-  return TableKeysIterator{ *this, index };
+template <typename U> static void putBigEndian(std::vector<unsigned char>& out, U value) {
+  for(int shift = (sizeof(U) - 1) * 8; shift >= 0; shift -= 8)
+    out.push_back(static_cast<unsigned char>(value >> shift));
+}
+
+template <typename U> static U getBigEndian(const unsigned char*& p) {
+  U value = 0;
+  for(std::size_t b = 0; b < sizeof(U); b++)
+    value = (value << 8) | *p++;
+  return value;
+}
+
+// LSD radix sort of (key, position) pairs, digits shared by all keys are skipped
+template <typename K, typename F> static void radixSort(std::span<std::size_t> index, F key) {
+  const std::size_t count = index.size();
+  std::vector<std::pair<K, std::size_t>> items(count);
+  std::vector<std::array<std::size_t, 256>> histogram(sizeof(K));
+  for(std::size_t i = 0; i < count; i++) {
+    K k = key(index[i]);
+    items[i] = { k, index[i] };
+    for(std::size_t d = 0; d < sizeof(K); d++)
+      histogram[d][static_cast<std::size_t>(k >> (d * 8)) & 0xFF]++;
+  }
+  std::vector<std::pair<K, std::size_t>> buffer(count);
+  for(std::size_t d = 0; d < sizeof(K); d++) {
+    auto& h = histogram[d];
+    if(std::find(h.begin(), h.end(), count) != h.end())
+      continue;
+    std::size_t offset = 0;
+    for(auto& c : h)
+      offset += std::exchange(c, offset);
+    for(auto& item : items)
+      buffer[h[static_cast<std::size_t>(item.first >> (d * 8)) & 0xFF]++] = item;
+    items.swap(buffer);
+  }
+  for(std::size_t i = 0; i < count; i++)
+    index[i] = items[i].second;
+}
+
+static std::uint64_t loadWord(const unsigned char* p) {
+  std::uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return be64toh(word);
+}
+
+/*****************************************************************************/
+/* comparators specialized for a primary key layout: pointers to the column  */
+/* data are taken once, the compare has no type dispatch                     */
+/*****************************************************************************/
+
+// raw view of a key column
+template <typename V> struct KeyColumn {
+  KeyColumn(const V& v)
+      : data{ v.data() } {}
+  typename V::value_type operator[](std::size_t i) const { return data[i]; }
+  const typename V::value_type* data;
+};
+
+template <> struct KeyColumn<StringArena> {
+  KeyColumn(const StringArena& v)
+      : data{ v.data() }, bounds{ v.bounds() } {}
+  std::string_view operator[](std::size_t i) const { return { data + bounds[i], bounds[i + 1] - bounds[i] }; }
+  const char* data;
+  const std::size_t* bounds;
+};
+
+template <> struct KeyKernel<> {
+  KeyKernel(const TableKeys& k1, const TableKeys& k2)
+      : keys1{ k1 }, keys2{ k2 } {}
+  std::partial_ordering compare(std::size_t i1, std::size_t i2) const { return keys1.compare(i1, keys2, i2); }
+  const TableKeys& keys1;
+  const TableKeys& keys2;
+};
+
+template <typename V0> struct KeyKernel<V0> {
+  KeyKernel(const TableKeys& k1, const TableKeys& k2)
+      : a0{ std::get<V0>(k1.keys[0].second) }, b0{ std::get<V0>(k2.keys[0].second) } {}
+  std::partial_ordering compare(std::size_t i1, std::size_t i2) const { return a0[i1] <=> b0[i2]; }
+  KeyColumn<V0> a0;
+  KeyColumn<V0> b0;
+};
+
+template <typename V0, typename V1> struct KeyKernel<V0, V1> {
+  KeyKernel(const TableKeys& k1, const TableKeys& k2)
+      : a0{ std::get<V0>(k1.keys[0].second) },
+        b0{ std::get<V0>(k2.keys[0].second) },
+        a1{ std::get<V1>(k1.keys[1].second) },
+        b1{ std::get<V1>(k2.keys[1].second) } {}
+  std::partial_ordering compare(std::size_t i1, std::size_t i2) const {
+    auto c = a0[i1] <=> b0[i2];
+    return c != 0 ? c : a1[i1] <=> b1[i2];
+  }
+  KeyColumn<V0> a0;
+  KeyColumn<V0> b0;
+  KeyColumn<V1> a1;
+  KeyColumn<V1> b1;
+};
+
+template <typename F> void TableKeys::dispatch(const TableKeys& other, F&& f) const {
+  assert(count == 0 || other.count == 0 || shape == other.shape);
+  if(count == 0 || other.count == 0)
+    return f(KeyKernel<>{ *this, other });
+  switch(shape) {
+  case Shape::Int:
+    return f(KeyKernel<vI>{ *this, other });
+  case Shape::Long:
+    return f(KeyKernel<vLL>{ *this, other });
+  case Shape::LongLong:
+    return f(KeyKernel<vLL, vLL>{ *this, other });
+  case Shape::LongString:
+    return f(KeyKernel<vLL, vS>{ *this, other });
+  case Shape::String:
+    return f(KeyKernel<vS>{ *this, other });
+  default:
+    return f(KeyKernel<>{ *this, other });
+  }
+}
+
+/*****************************************************************************/
+
+TableKeys::TableKeys(bool e, bool d)
+    : count{ 0 },
+      expected{ 0 },
+      capacity{ 0 },
+      sorted(true),
+      shape{ Shape::Generic },
+      encoded{ e },
+      width{ 0 },
+      digests{ d } {}
+
+TableKeysIterator TableKeys::iter(bool flag) const { return TableKeysIterator{ *this, flag }; }
+
+TableKeysIterator TableKeys::iter(bool flag, const KeyFlags& bits) const {
+  assert(bits.size() == count);
+  return TableKeysIterator{ *this, bits, flag };
 }
 
 void TableKeys::init(const soci::row& row) {
-  for(std::size_t i = 0; i < row.size(); i++)
+  // the record md5, if any, follows the key columns
+  std::size_t columns = row.size() - (digests ? 1 : 0);
+  for(std::size_t i = 0; i < columns; i++)
     names.push_back(row.get_properties(i).get_name());
-  for(std::size_t i = 0; i < row.size(); ++i) {
+  if(encoded) {
+    bool fixed = true;
+    for(std::size_t i = 0; i < columns; ++i) {
+      auto dType = row.get_properties(i).get_data_type();
+      switch(dType) {
+      case soci::dt_string:
+      case soci::dt_xml:
+      case soci::dt_blob:
+        fixed = false;
+        break;
+      case soci::dt_integer:
+        width += sizeof(std::uint32_t);
+        break;
+      default:
+        width += sizeof(std::uint64_t);
+        break;
+      }
+      keys.emplace_back(std::make_pair(dType, vect{}));
+    }
+    if(!fixed) {
+      width = 0;
+      offsets.push_back(0);
+    }
+    grow(std::max(expected + expected / 8, MIN_RESERVE));
+    return;
+  }
+  for(std::size_t i = 0; i < columns; ++i) {
     vect v;
     auto dType = row.get_properties(i).get_data_type();
     switch(dType) {
     case soci::dt_string:
     case soci::dt_xml:
-    case soci::dt_blob: {
-      vS tmp;
-      tmp.reserve(RESERVE);
-      v = tmp;
-    } break;
-    case soci::dt_date: {
-      vT tmp;
-      tmp.reserve(RESERVE);
-      v = tmp;
-    } break;
-    case soci::dt_double: {
-      vD tmp;
-      tmp.reserve(RESERVE);
-      v = tmp;
-    } break;
-    case soci::dt_integer: {
-      vI tmp;
-      tmp.reserve(RESERVE);
-      v = tmp;
-    } break;
-    case soci::dt_long_long: {
-      vLL tmp;
-      tmp.reserve(RESERVE);
-      v = tmp;
-    } break;
-    case soci::dt_unsigned_long_long: {
-      vULL tmp;
-      tmp.reserve(RESERVE);
-      v = tmp;
-    } break;
+    case soci::dt_blob:
+      v = vS{};
+      break;
+    case soci::dt_date:
+      v = vT{};
+      break;
+    case soci::dt_double:
+      v = vD{};
+      break;
+    case soci::dt_integer:
+      v = vI{};
+      break;
+    case soci::dt_long_long:
+      v = vLL{};
+      break;
+    case soci::dt_unsigned_long_long:
+      v = vULL{};
+      break;
     }
     keys.emplace_back(std::make_pair(dType, v));
   }
+  auto isString = [](soci::data_type t) { return t == soci::dt_string || t == soci::dt_xml || t == soci::dt_blob; };
+  if(keys.size() == 1 && keys[0].first == soci::dt_integer)
+    shape = Shape::Int;
+  else if(keys.size() == 1 && keys[0].first == soci::dt_long_long)
+    shape = Shape::Long;
+  else if(keys.size() == 1 && isString(keys[0].first))
+    shape = Shape::String;
+  else if(keys.size() == 2 && keys[0].first == soci::dt_long_long && keys[1].first == soci::dt_long_long)
+    shape = Shape::LongLong;
+  else if(keys.size() == 2 && keys[0].first == soci::dt_long_long && isString(keys[1].first))
+    shape = Shape::LongString;
+  // a stale estimate is corrected by the growth in loadRow
+  grow(std::max(expected + expected / 8, MIN_RESERVE));
+}
+
+void TableKeys::reserve(std::size_t rows) {
+  expected = rows;
+  if(count > 0 && rows > capacity)
+    grow(rows);
+}
+
+void TableKeys::grow(std::size_t rows) {
+  if(encoded) {
+    // variable size keys are sized on the average length loaded so far
+    std::size_t length = width > 0 ? width : count > 0 ? store.size() / count + 1 : 16;
+    store.reserve(rows * length);
+    if(width == 0)
+      offsets.reserve(rows + 1);
+  }
+  for(std::size_t i = 0; !encoded && i < keys.size(); i++)
+    std::visit([rows](auto& column) { column.reserve(rows); }, keys[i].second);
+  if(digests)
+    digest.reserve(rows * DIGEST);
+  capacity = rows;
 }
 
 void TableKeys::loadRow(const soci::row& row) {
   assert(count < std::numeric_limits<std::size_t>::max());
   if(count == 0)
     init(row);
-  for(std::size_t i = 0; i < row.size(); ++i) {
+  else if(count == capacity)
+    grow(count + std::max(count / 2, MIN_RESERVE));
+  if(encoded)
+    encode(row);
+  if(digests) {
+    std::string md5 = row.get<std::string>(keys.size());
+    assert(md5.size() == DIGEST);
+    digest.insert(digest.end(), md5.begin(), md5.end());
+  }
+  for(std::size_t i = 0; !encoded && i < keys.size(); ++i) {
     auto dType = row.get_properties(i).get_data_type();
     switch(dType) {
     case soci::dt_string:
     case soci::dt_xml:
     case soci::dt_blob:
-      std::get<vS>(keys[i].second).emplace_back(row.get<std::string>(i));
+      std::get<vS>(keys[i].second).push_back(row.get<std::string>(i));
       break;
     case soci::dt_date: {
       std::tm tm = row.get<std::tm>(i);
@@ -113,16 +315,66 @@ void TableKeys::loadRow(const soci::row& row) {
     sorted = less(count - 2, count - 1);
 }
 
-void TableKeys::bind(soci::statement& stmt, std::size_t i) const {
+void TableKeys::append(TableKeys& other) {
+  assert(index.empty());
+  if(other.count == 0)
+    return;
+  if(count == 0) {
+    std::swap(*this, other);
+    return;
+  }
+  assert(keys.size() == other.keys.size());
+  assert(encoded == other.encoded);
+  assert(digests == other.digests);
+  sorted = sorted && other.sorted && compare(count - 1, other, 0) == std::partial_ordering::less;
+  if(count + other.count > capacity)
+    grow(count + other.count);
+  if(encoded) {
+    assert(width == other.width);
+    std::size_t base = store.size();
+    store.insert(store.end(), other.store.begin(), other.store.end());
+    for(std::size_t i = 1; i < other.offsets.size(); i++)
+      offsets.push_back(base + other.offsets[i]);
+    other.store = {};
+    other.offsets = {};
+  }
+  digest.insert(digest.end(), other.digest.begin(), other.digest.end());
+  other.digest = {};
+  for(std::size_t i = 0; !encoded && i < keys.size(); i++) {
+    std::visit(
+        [&](auto& dest) {
+          using V = std::decay_t<decltype(dest)>;
+          auto& src = std::get<V>(other.keys[i].second);
+          if constexpr(std::is_same_v<V, vS>)
+            dest.append(src);
+          else
+            dest.insert(dest.end(), src.begin(), src.end());
+          src = {};
+        },
+        keys[i].second);
+  }
+  count += other.count;
+  other.count = 0;
+}
+
+void TableKeys::bind(soci::statement& stmt, std::size_t i, DbRecords& values) const {
   assert(i < count);
   auto idx = index[i];
-  for(int i = 0; i < keys.size(); i++) {
+  if(encoded) {
+    // decoded values must outlive the statement execution
+    auto& key = values.emplace_back(decode(idx));
+    for(auto& field : key)
+      std::visit([&stmt](const auto& v) { stmt.exchange(soci::use(v)); }, field.second);
+  }
+  for(int i = 0; !encoded && i < keys.size(); i++) {
     switch(keys[i].first) {
     case soci::dt_string:
     case soci::dt_xml:
-    case soci::dt_blob:
-      stmt.exchange(soci::use(std::get<vS>(keys[i].second)[idx]));
-      break;
+    case soci::dt_blob: {
+      // strings are bound from a copy that must outlive the statement execution
+      auto& copy = values.emplace_back(DbRecord{ { keys[i].first, std::string{ std::get<vS>(keys[i].second)[idx] } } });
+      stmt.exchange(soci::use(std::get<std::string>(copy[0].second)));
+    } break;
     case soci::dt_date:
       stmt.exchange(soci::use(std::get<vT>(keys[i].second)[idx]));
       break;
@@ -147,6 +399,15 @@ std::string TableKeys::rowString(std::size_t i) const {
   assert(i < count);
   std::size_t idx = index[i];
   std::stringstream s;
+  if(encoded) {
+    auto key = decode(idx);
+    for(int i = 0; i < key.size(); i++) {
+      s << names[i] << '[';
+      std::visit([&s](const auto& v) { s << v; }, key[i].second);
+      s << "] ";
+    }
+    return s.str();
+  }
   for(int i = 0; i < keys.size(); i++) {
     s << names[i] << '[';
     switch(keys[i].first) {
@@ -177,25 +438,72 @@ std::string TableKeys::rowString(std::size_t i) const {
   return s.str();
 }
 
-void TableKeys::sort(const char* ref) {
+DbRecord TableKeys::record(std::size_t idx) const {
+  assert(idx < count);
+  if(encoded)
+    return decode(idx);
+  DbRecord record;
+  for(std::size_t i = 0; i < keys.size(); i++) {
+    DbValue v;
+    switch(keys[i].first) {
+    case soci::dt_string:
+    case soci::dt_xml:
+    case soci::dt_blob:
+      v = std::string{ std::get<vS>(keys[i].second)[idx] };
+      break;
+    case soci::dt_date: {
+      // bound as text so that the server compares it as a datetime
+      std::tm tm;
+      localtime_r(&std::get<vT>(keys[i].second)[idx], &tm);
+      v = fmt::format("{:%F %T}", tm);
+    } break;
+    case soci::dt_double:
+      v = std::get<vD>(keys[i].second)[idx];
+      break;
+    case soci::dt_integer:
+      v = std::get<vI>(keys[i].second)[idx];
+      break;
+    case soci::dt_long_long:
+      v = std::get<vLL>(keys[i].second)[idx];
+      break;
+    case soci::dt_unsigned_long_long:
+      v = std::get<vULL>(keys[i].second)[idx];
+      break;
+    }
+    record.emplace_back(std::make_pair(keys[i].first, v));
+  }
+  return record;
+}
+
+void TableKeys::sort(const char* ref, std::size_t threads) {
   assert(index.empty());
   index.reserve(count);
-  flags.reserve(count);
+  flags.resize(count);
+  changed.resize(digests ? count : 0);
   TimerMs timer;
-  LOG4CXX_DEBUG_FMT(log, "sort {} begin [keys: {}] [RSS: {}]", ref, count, memoryUsage());
-  for(std::size_t i = 0; i < count; i++) {
+  const char* path = count == 0 || sorted ? "presorted" : radixSortable() ? "radix" : "comparison";
+  threads = std::clamp<std::size_t>(count / SORT_CHUNK, 1, std::max<std::size_t>(threads, 1));
+  LOG4CXX_DEBUG_FMT(log,
+                    "sort {} begin [keys: {}] [path: {}] [threads: {}] [RSS: {}]",
+                    ref,
+                    count,
+                    path,
+                    threads,
+                    memoryUsage());
+  for(std::size_t i = 0; i < count; i++)
     index.emplace_back(i);
-    flags.emplace_back(false);
-  }
   LOG4CXX_TRACE_FMT(log, "sort {} index [RSS: {}]", ref, memoryUsage());
-  if(count > 0 && !sorted)
-    std::sort(std::execution::seq, index.begin(), index.end(), [&](const std::size_t& i1, const std::size_t& i2) {
-      return less(i1, i2);
-    });
+  if(count > 0 && !sorted) {
+    if(threads > 1)
+      sortParallel(threads);
+    else
+      sortRange(index);
+  }
   auto e = timer.elapsed(count);
   LOG4CXX_DEBUG_FMT(log,
-                    "sort {} done [{} keys/sec] [elapsed {}] [RSS: {}]",
+                    "sort {} done [{}] [{} keys/sec] [elapsed {}] [RSS: {}]",
                     ref,
+                    path,
                     (int)e.speed<std::chrono::seconds>(),
                     e.elapsed().string(),
                     memoryUsage());
@@ -206,6 +514,145 @@ void TableKeys::sort(const char* ref) {
 #endif
 }
 
+void TableKeys::sortRange(std::span<std::size_t> range) {
+  if(radixSortable())
+    radixSort(range);
+  else
+    dispatch(*this, [&](const auto& kernel) {
+      std::sort(std::execution::seq, range.begin(), range.end(), [&](const std::size_t& i1, const std::size_t& i2) {
+        return kernel.compare(i1, i2) < 0;
+      });
+    });
+}
+
+template <typename C>
+void TableKeys::mergeRuns(std::vector<std::size_t>& bounds, std::vector<std::size_t>& buffer, C& comp) {
+  std::vector<std::future<void>> tasks;
+  while(bounds.size() > 2) {
+    std::vector<std::size_t> merged{ 0 };
+    tasks.clear();
+    for(std::size_t r = 0; r + 1 < bounds.size(); r += 2) {
+      auto lo = bounds[r];
+      auto mid = bounds[r + 1];
+      auto hi = r + 2 < bounds.size() ? bounds[r + 2] : mid;
+      tasks.emplace_back(std::async(std::launch::async, [&, lo, mid, hi] {
+        std::merge(index.begin() + lo,
+                   index.begin() + mid,
+                   index.begin() + mid,
+                   index.begin() + hi,
+                   buffer.begin() + lo,
+                   comp);
+      }));
+      merged.push_back(hi);
+    }
+    for(auto& task : tasks)
+      task.get();
+    index.swap(buffer);
+    bounds.swap(merged);
+  }
+}
+
+// each thread sorts a chunk of the index, then sorted runs are merged in pairs
+void TableKeys::sortParallel(std::size_t threads) {
+  std::vector<std::size_t> bounds;
+  for(std::size_t t = 0; t <= threads; t++)
+    bounds.push_back(count * t / threads);
+  std::vector<std::future<void>> tasks;
+  for(std::size_t t = 0; t < threads; t++)
+    tasks.emplace_back(std::async(std::launch::async, [&, t] {
+      sortRange(std::span<std::size_t>{ index.begin() + bounds[t], index.begin() + bounds[t + 1] });
+    }));
+  for(auto& task : tasks)
+    task.get();
+  std::vector<std::size_t> buffer(count);
+  dispatch(*this, [&](const auto& kernel) {
+    auto comp = [&](const std::size_t& i1, const std::size_t& i2) { return kernel.compare(i1, i2) < 0; };
+    mergeRuns(bounds, buffer, comp);
+  });
+}
+
+bool TableKeys::hasStrings() const {
+  return std::any_of(keys.begin(), keys.end(), [](const key_type& k) {
+    return k.first == soci::dt_string || k.first == soci::dt_xml || k.first == soci::dt_blob;
+  });
+}
+
+bool TableKeys::radixSortable() const {
+  if(encoded || keys.empty() || keys.size() > 2)
+    return false;
+  return std::all_of(keys.begin(), keys.end(), [](const key_type& k) {
+    return k.first == soci::dt_integer || k.first == soci::dt_long_long || k.first == soci::dt_unsigned_long_long;
+  });
+}
+
+// number of keys from the sorted position i with the same flag in bits and consecutive
+// values of a single integer column (at most max), 1 for any other primary key
+std::size_t TableKeys::run(const KeyFlags& bits, std::size_t i, bool flag, std::size_t max) const {
+  assert(i < count && max > 0);
+  if(keys.size() != 1 || !radixSortable())
+    return 1;
+  // the radix key keeps the distance between integer values
+  const std::uint64_t first = radixKey(0, index[i]);
+  std::size_t n = 1;
+  while(n < max && i + n < count && bits[i + n] == flag && radixKey(0, index[i + n]) == first + n)
+    n++;
+  return n;
+}
+
+std::uint64_t TableKeys::radixKey(std::size_t column, std::size_t idx) const {
+  switch(keys[column].first) {
+  case soci::dt_integer:
+    return static_cast<std::uint32_t>(std::get<vI>(keys[column].second)[idx]) ^ SIGN32;
+  case soci::dt_long_long:
+    return static_cast<std::uint64_t>(std::get<vLL>(keys[column].second)[idx]) ^ SIGN64;
+  case soci::dt_unsigned_long_long:
+    return std::get<vULL>(keys[column].second)[idx];
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+void TableKeys::radixSort(std::span<std::size_t> range) {
+  assert(radixSortable());
+  if(keys.size() == 1) {
+    dbsync::radixSort<std::uint64_t>(range, [&](std::size_t i) { return radixKey(0, i); });
+  } else if(keys[0].first == soci::dt_integer && keys[1].first == soci::dt_integer) {
+    dbsync::radixSort<std::uint64_t>(range, [&](std::size_t i) { return radixKey(0, i) << 32 | radixKey(1, i); });
+  } else {
+    dbsync::radixSort<unsigned __int128>(range, [&](std::size_t i) {
+      return static_cast<unsigned __int128>(radixKey(0, i)) << 64 | radixKey(1, i);
+    });
+  }
+}
+
+// merge of the sorted keys, flags the keys missing in the other side and with
+// the records md5 loaded the common keys of changed records
+void TableKeys::diff(TableKeys& other) {
+  assert(digests == other.digests);
+  dispatch(other, [&](const auto& kernel) {
+    std::size_t i1 = 0;
+    std::size_t i2 = 0;
+    while(i1 < count && i2 < other.count) {
+      auto c = kernel.compare(index[i1], other.index[i2]);
+      if(c < 0) {
+        setFlag(i1++);
+      } else if(c > 0) {
+        other.setFlag(i2++);
+      } else {
+        if(digests && std::memcmp(&digest[index[i1] * DIGEST], &other.digest[other.index[i2] * DIGEST], DIGEST) != 0)
+          changed.set(i1, true);
+        i1++;
+        i2++;
+      }
+    }
+    while(i1 < count)
+      setFlag(i1++);
+    while(i2 < other.count)
+      other.setFlag(i2++);
+  });
+}
+
 bool TableKeys::less(std::size_t i1, const TableKeys& other, std::size_t i2) const {
   assert(i1 < count);
   assert(i2 < other.count);
@@ -224,7 +671,14 @@ bool TableKeys::less(std::size_t i1, std::size_t i2) const {
 
 bool TableKeys::check(std::size_t idx, DbRecord record) const {
   assert(idx < count);
-  assert(keys.size() == record.size());
+  assert(keys.size() <= record.size()); // fields after the key are not checked
+  if(encoded) {
+    auto key = decode(index[idx]);
+    for(std::size_t i = 0; i < key.size(); i++)
+      if(keys[i].first != soci::dt_date && key[i].second != record[i].second)
+        return false;
+    return true;
+  }
   std::partial_ordering comp = std::partial_ordering::equivalent;
   for(std::size_t i = 0; comp == std::partial_ordering::equivalent && i < keys.size() - 1; i++) {
     if(keys[i].first != record[i].first) {
@@ -261,6 +715,23 @@ bool TableKeys::check(std::size_t idx, DbRecord record) const {
 std::partial_ordering TableKeys::compare(std::size_t i1, const TableKeys& other, std::size_t i2) const {
   assert(i1 < count);
   assert(i2 < other.count);
+  if(encoded) {
+    assert(other.encoded);
+    auto [p1, l1] = encodedKey(i1);
+    auto [p2, l2] = other.encodedKey(i2);
+    std::size_t n = std::min(l1, l2);
+    std::size_t w = 0;
+    for(; w + sizeof(std::uint64_t) <= n; w += sizeof(std::uint64_t)) {
+      auto k1 = loadWord(p1 + w);
+      auto k2 = loadWord(p2 + w);
+      if(k1 != k2)
+        return k1 <=> k2;
+    }
+    int c = std::memcmp(p1 + w, p2 + w, n - w);
+    if(c != 0)
+      return c <=> 0;
+    return l1 <=> l2;
+  }
   std::partial_ordering comp = std::partial_ordering::equivalent;
   for(std::size_t i = 0; comp == std::partial_ordering::equivalent && i < keys.size(); i++) {
     switch(keys[i].first) {
@@ -290,35 +761,159 @@ std::partial_ordering TableKeys::compare(std::size_t i1, const TableKeys& other,
   return comp;
 }
 
-void TableKeys::swap(std::size_t i1, std::size_t i2) {
-  assert(i1 < count);
-  assert(i2 < count);
-  if(i1 == i2)
+void KeyFlags::set(std::size_t i, bool value) {
+  assert(i < bits);
+  std::uint64_t& word = words[i >> 6];
+  std::uint64_t mask = std::uint64_t{ 1 } << (i & 63);
+  if(((word & mask) != 0) == value)
     return;
-  for(std::size_t i = 0; i < keys.size(); i++) {
+  word ^= mask;
+  value ? ones++ : ones--;
+}
+
+void KeyFlags::set(std::size_t from, std::size_t to, bool value) {
+  assert(from <= to && to <= bits);
+  while(from < to) {
+    std::uint64_t& word = words[from >> 6];
+    std::size_t end = std::min(to, (from | 63) + 1);
+    std::size_t n = end - from;
+    std::uint64_t mask = (n == 64 ? ~std::uint64_t{ 0 } : (std::uint64_t{ 1 } << n) - 1) << (from & 63);
+    std::size_t changed = std::popcount((value ? ~word : word) & mask);
+    value ? ones += changed : ones -= changed;
+    word = value ? word | mask : word & ~mask;
+    from = end;
+  }
+}
+
+void KeyFlags::flip() {
+  for(auto& word : words)
+    word = ~word;
+  if(bits % 64 != 0) // keep the bits past the end clear
+    words.back() &= (std::uint64_t{ 1 } << (bits % 64)) - 1;
+  ones = bits - ones;
+}
+
+// position of the first flag equal to value from i, size() if none
+std::size_t KeyFlags::next(std::size_t i, bool value) const {
+  if(i >= bits)
+    return bits;
+  std::size_t w = i >> 6;
+  std::uint64_t word = (value ? words[w] : ~words[w]) & (~std::uint64_t{ 0 } << (i & 63));
+  while(word == 0) {
+    if(++w == words.size())
+      return bits;
+    word = value ? words[w] : ~words[w];
+  }
+  return std::min(w * 64 + std::countr_zero(word), bits);
+}
+
+/*****************************************************************************/
+
+void StringArena::reserve(std::size_t n) {
+  offsets.reserve(n + 1);
+  if(size() > 0) // bytes sized on the average value length
+    bytes.reserve(bytes.size() / size() * n);
+}
+
+void StringArena::append(const StringArena& other) {
+  std::size_t base = bytes.size();
+  bytes.insert(bytes.end(), other.bytes.begin(), other.bytes.end());
+  offsets.reserve(offsets.size() + other.size());
+  for(std::size_t i = 1; i < other.offsets.size(); i++)
+    offsets.push_back(base + other.offsets[i]);
+}
+
+/*****************************************************************************/
+
+std::pair<const unsigned char*, std::size_t> TableKeys::encodedKey(std::size_t idx) const {
+  if(width > 0)
+    return { store.data() + idx * width, width };
+  return { store.data() + offsets[idx], offsets[idx + 1] - offsets[idx] };
+}
+
+void TableKeys::encode(const soci::row& row) {
+  for(std::size_t i = 0; i < keys.size(); ++i) {
     switch(keys[i].first) {
     case soci::dt_string:
     case soci::dt_xml:
     case soci::dt_blob:
-      std::swap(std::get<vS>(keys[i].second)[i1], std::get<vS>(keys[i].second)[i2]);
+      for(unsigned char c : row.get<std::string>(i)) {
+        store.push_back(c);
+        if(c == 0)
+          store.push_back(0xFF);
+      }
+      store.push_back(0);
+      store.push_back(0);
       break;
-    case soci::dt_date:
-      std::swap(std::get<vT>(keys[i].second)[i1], std::get<vT>(keys[i].second)[i2]);
+    case soci::dt_date: {
+      std::tm tm = row.get<std::tm>(i);
+      putBigEndian<std::uint64_t>(store, static_cast<std::uint64_t>(std::mktime(&tm)) ^ SIGN64);
+    } break;
+    case soci::dt_double: {
+      double d = row.get<double>(i);
+      std::uint64_t bits;
+      std::memcpy(&bits, &d, sizeof(bits));
+      putBigEndian<std::uint64_t>(store, bits & SIGN64 ? ~bits : bits ^ SIGN64);
+    } break;
+    case soci::dt_integer:
+      putBigEndian<std::uint32_t>(store, static_cast<std::uint32_t>(row.get<int>(i)) ^ SIGN32);
       break;
-    case soci::dt_double:
-      std::swap(std::get<vD>(keys[i].second)[i1], std::get<vD>(keys[i].second)[i2]);
+    case soci::dt_long_long:
+      putBigEndian<std::uint64_t>(store, static_cast<std::uint64_t>(row.get<long long>(i)) ^ SIGN64);
       break;
+    case soci::dt_unsigned_long_long:
+      putBigEndian<std::uint64_t>(store, row.get<unsigned long long>(i));
+      break;
+    }
+  }
+  if(width == 0)
+    offsets.push_back(store.size());
+}
+
+DbRecord TableKeys::decode(std::size_t idx) const {
+  assert(encoded);
+  const unsigned char* p = encodedKey(idx).first;
+  DbRecord record;
+  for(std::size_t i = 0; i < keys.size(); i++) {
+    DbValue v;
+    switch(keys[i].first) {
+    case soci::dt_string:
+    case soci::dt_xml:
+    case soci::dt_blob: {
+      std::string str;
+      while(p[0] != 0 || p[1] != 0) {
+        str.push_back(static_cast<char>(*p));
+        p += p[0] == 0 ? 2 : 1;
+      }
+      p += 2;
+      v = std::move(str);
+    } break;
+    case soci::dt_date: {
+      std::time_t t = static_cast<std::time_t>(getBigEndian<std::uint64_t>(p) ^ SIGN64);
+      std::tm tm;
+      localtime_r(&t, &tm);
+      v = fmt::format("{:%F %T}", tm);
+    } break;
+    case soci::dt_double: {
+      std::uint64_t bits = getBigEndian<std::uint64_t>(p);
+      bits = bits & SIGN64 ? bits ^ SIGN64 : ~bits;
+      double d;
+      std::memcpy(&d, &bits, sizeof(d));
+      v = d;
+    } break;
     case soci::dt_integer:
-      std::swap(std::get<vI>(keys[i].second)[i1], std::get<vI>(keys[i].second)[i2]);
+      v = static_cast<int>(getBigEndian<std::uint32_t>(p) ^ SIGN32);
       break;
     case soci::dt_long_long:
-      std::swap(std::get<vLL>(keys[i].second)[i1], std::get<vLL>(keys[i].second)[i2]);
+      v = static_cast<long long>(getBigEndian<std::uint64_t>(p) ^ SIGN64);
       break;
     case soci::dt_unsigned_long_long:
-      std::swap(std::get<vULL>(keys[i].second)[i1], std::get<vULL>(keys[i].second)[i2]);
+      v = static_cast<unsigned long long>(getBigEndian<std::uint64_t>(p));
       break;
     }
+    record.emplace_back(std::make_pair(keys[i].first, v));
   }
+  return record;
 }
 
 /*****************************************************************************/
@@ -42,8 +42,16 @@ b::optional<std::string> toSchema;
 dbsync::strings tables;
 b::optional<int> jobs;
 b::optional<int> pkBulk;
+b::optional<int> pkJobs;
+b::optional<int> sortJobs;
 b::optional<int> compareBulk;
 b::optional<int> modifyBulk;
+b::optional<int> deleteBulk;
+b::optional<int> chunkRows;
+b::optional<int> poolThreads;
+b::optional<int> insertRows;
+b::optional<int> insertBytes;
+b::optional<std::string> updateMode;
 
 const po::options_description OPTIONS = [] {
   po::options_description options{ "Allowed arguments" };
@@ -53,6 +61,23 @@ const po::options_description OPTIONS = [] {
   options.add_options()("sync,s", "sync records from source to target");
   options.add_options()("dry-run,d", "execute without modifying the target database");
   options.add_options()("update", "enable update of records from source to target");
+  options.add_options()("rangeChecksum",
+                        "with 'update' compare checksums of primary key ranges before the records md5");
+  options.add_options()("pkChecksum", "with 'update' load the records md5 with the primary keys (no compare phase)");
+  options.add_options()("updateMode",
+                        po::value<>(&updateMode)->default_value(std::string{ "single" }),
+                        "with 'update' write changed records with one update each (single) or with multi-row "
+                        "INSERT ... ON DUPLICATE KEY UPDATE (upsert) or REPLACE (replace)");
+  options.add_options()("partialUpdate", "with 'update' compare and update only the changed columns of a record");
+  options.add_options()("pipeline", "read the next block of records from source while writing the current one");
+  options.add_options()("concurrentPhases",
+                        "copy and update the records of a table at the same time on separate connections");
+  options.add_options()("stream", "compare primary keys in windows of pkBulk keys (constant memory)");
+  options.add_options()("encodeKeys", "store primary keys as binary comparable strings (faster sort and compare)");
+  options.add_options()("keyTable",
+                        "read and delete records joining the keys loaded in a temporary table instead of listing them");
+  options.add_options()("loadData",
+                        "copy records with LOAD DATA LOCAL INFILE (target local_infile must be enabled)");
   options.add_options()("nofail", "don't stop if error on target records");
   options.add_options()("disablebinlog", "disable binary log (privilege required)");
   options.add_options()("fromHost", po::value<>(&fromHost), "source database host IP or name");
@@ -74,14 +99,38 @@ const po::options_description OPTIONS = [] {
   options.add_options()("jobs",
                         po::value<>(&jobs)->default_value(1),
                         "number of parallel execution jobs, use 0 to set as the numbers of cores");
+  options.add_options()("poolThreads",
+                        po::value<>(&poolThreads)->default_value(0),
+                        "number of threads running the parallel loads of the jobs, use 0 to set as twice the jobs "
+                        "(four times with concurrentPhases)");
   options.add_options()(
       "pkBulk", po::value<>(&pkBulk)->default_value(10000000), "number of primary keys to read with a single query");
+  options.add_options()("pkJobs",
+                        po::value<>(&pkJobs)->default_value(1),
+                        "number of parallel connections used to load the primary keys of a large table");
+  options.add_options()(
+      "sortJobs",
+      po::value<>(&sortJobs)->default_value(1),
+      "number of threads used to sort the primary keys of a table, use 0 to set as the numbers of cores");
   options.add_options()("compareBulk",
                         po::value<>(&compareBulk)->default_value(10000),
                         "number of records to read to compare md5 content when option 'update' is used");
   options.add_options()("modifyBulk",
                         po::value<>(&modifyBulk)->default_value(5000),
                         "number of records to read to insert/update in a single transaction");
+  options.add_options()("chunkRows",
+                        po::value<>(&chunkRows)->default_value(0),
+                        "split tables with more rows in primary key ranges of about this size processed by any job, "
+                        "0 to process each table in a single job");
+  options.add_options()("deleteBulk",
+                        po::value<>(&deleteBulk)->default_value(1000),
+                        "number of records to delete with a single statement and transaction");
+  options.add_options()("insertRows",
+                        po::value<>(&insertRows)->default_value(1000),
+                        "max number of records inserted with a single statement, 1 to insert one by one");
+  options.add_options()("insertBytes",
+                        po::value<>(&insertBytes)->default_value(1048576),
+                        "approximate max size in bytes of the records inserted with a single statement");
   return options;
 }();
 
@@ -125,6 +174,41 @@ int main(int argc, char* argv[]) {
     std::cerr << "modifyBulk must be a positive integer" << std::endl;
     return 5;
   }
+  if(pkJobs && *pkJobs < 1) {
+    std::cerr << "pkJobs must be a positive integer" << std::endl;
+    return 6;
+  }
+  if(sortJobs && *sortJobs < 0) {
+    std::cerr << "sortJobs must be a positive integer" << std::endl;
+    return 7;
+  }
+  if(insertRows && *insertRows < 1) {
+    std::cerr << "insertRows must be a positive integer" << std::endl;
+    return 8;
+  }
+  if(insertBytes && *insertBytes < 1) {
+    std::cerr << "insertBytes must be a positive integer" << std::endl;
+    return 9;
+  }
+  const std::map<std::string, dbsync::UpdateMode> UPDATE_MODES{ { "single", dbsync::UpdateMode::Single },
+                                                                 { "upsert", dbsync::UpdateMode::Upsert },
+                                                                 { "replace", dbsync::UpdateMode::Replace } };
+  if(updateMode && !UPDATE_MODES.contains(*updateMode)) {
+    std::cerr << "updateMode must be one of single, upsert, replace" << std::endl;
+    return 13;
+  }
+  if(deleteBulk && *deleteBulk < 1) {
+    std::cerr << "deleteBulk must be a positive integer" << std::endl;
+    return 14;
+  }
+  if(chunkRows && *chunkRows < 0) {
+    std::cerr << "chunkRows must be a positive integer" << std::endl;
+    return 15;
+  }
+  if(poolThreads && *poolThreads < 0) {
+    std::cerr << "poolThreads must be a positive integer" << std::endl;
+    return 16;
+  }
   if(check == 0 || params.count("help")) {
     std::cout << OPTIONS << std::endl;
     return 0;
@@ -172,7 +256,7 @@ int main(int argc, char* argv[]) {
     return 20;
   }
   std::shared_ptr<dbsync::DbMeta> toDb = std::make_shared<dbsync::DbMeta>("target");
-  if(!toDb->open(*toHost, *toPort, *toSchema, *toUser, *toPwd)) {
+  if(!toDb->open(*toHost, *toPort, *toSchema, *toUser, *toPwd, params.count("loadData") > 0)) {
     std::cerr << "target db connection error, see log file for details" << std::endl;
     return 21;
   }
@@ -189,13 +273,31 @@ int main(int argc, char* argv[]) {
   // check metadata
   dbsync::OperationConfig config{ .mode = params.count("copy") > 0 ? dbsync::Mode::Copy : dbsync::Mode::Sync,
                                   .update = params.count("update") > 0,
+                                  .rangeChecksum = params.count("rangeChecksum") > 0,
+                                  .pkChecksum = params.count("pkChecksum") > 0,
+                                  .updateMode = UPDATE_MODES.at(*updateMode),
+                                  .partialUpdate = params.count("partialUpdate") > 0,
+                                  .loadData = params.count("loadData") > 0,
+                                  .pipeline = params.count("pipeline") > 0,
+                                  .concurrentPhases = params.count("concurrentPhases") > 0,
+                                  .stream = params.count("stream") > 0,
+                                  .encodeKeys = params.count("encodeKeys") > 0,
+                                  .keyTable = params.count("keyTable") > 0,
                                   .dryRun = params.count("dry-run") > 0,
                                   .tables = tables,
                                   .disableBinLog = params.count("disablebinlog") > 0,
                                   .noFail = params.count("nofail") > 0,
                                   .pkBulk = static_cast<std::size_t>(*pkBulk),
+                                  .pkJobs = static_cast<std::size_t>(*pkJobs),
+                                  .sortJobs = static_cast<std::size_t>(
+                                      *sortJobs > 0 ? *sortJobs : (int)std::thread::hardware_concurrency()),
                                   .compareBulk = static_cast<std::size_t>(*compareBulk),
-                                  .modifyBulk = static_cast<std::size_t>(*modifyBulk) };
+                                  .modifyBulk = static_cast<std::size_t>(*modifyBulk),
+                                  .chunkRows = static_cast<std::size_t>(*chunkRows),
+                                  .poolThreads = static_cast<std::size_t>(*poolThreads),
+                                  .deleteBulk = static_cast<std::size_t>(*deleteBulk),
+                                  .insertRows = static_cast<std::size_t>(*insertRows),
+                                  .insertBytes = static_cast<std::size_t>(*insertBytes) };
   manager = std::make_shared<dbsync::Operation>(config, fromDb, toDb);
   if(!manager->checkTables(fromTables, toTables)) {
     std::cerr << "tables check failed" << std::endl;
@@ -216,7 +318,13 @@ int main(int argc, char* argv[]) {
     return 50;
   }
   // create and initialize workers
-  int jobCount = std::min(manager->tablesCount(), *jobs > 0 ? *jobs : (int)std::thread::hardware_concurrency());
+  // split tables can keep busy more jobs than tables
+  int jobCount = *jobs > 0 ? *jobs : (int)std::thread::hardware_concurrency();
+  if(*chunkRows == 0)
+    jobCount = std::min(manager->tablesCount(), jobCount);
+  // each job (and each of its phases) loads source and target in parallel
+  int phases = params.count("concurrentPhases") > 0 ? 2 : 1;
+  manager->startPool(*poolThreads > 0 ? *poolThreads : 2 * jobCount * phases);
   bool ok = true;
   std::vector<dbsync::OpJob> workers;
   for(int i = 0; ok && i < jobCount; i++) {
@@ -232,22 +340,8 @@ int main(int argc, char* argv[]) {
   std::vector<std::thread> threads(jobCount);
   for(int i = 0; i < jobCount; i++)
     threads[i] = std::thread([i, &workers] { workers[i].execute(); });
-  // wait thread termination
-  bool someRunning = true;
-  do {
-    if(someRunning)
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-    someRunning = false;
-    for(auto& worker : workers) {
-      if(worker.isRunning()) {
-        someRunning = true;
-      } else {
-        ok &= worker.result();
-      }
-    }
-    if(!ok && manager->canRun())
-      manager->stop();
-  } while(someRunning);
+  // wait thread termination, the first failure stops the other jobs
+  ok = manager->waitJobs(jobCount);
   for(auto& thread : threads)
     thread.join();
   auto time = timer.elapsed().elapsed().string();
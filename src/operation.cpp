@@ -36,6 +36,26 @@ void Operation::stop() {
   run = false;
 }
 
+void Operation::jobEnded(bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    endedJobs++;
+    failedJobs += ok ? 0 : 1;
+  }
+  ended.notify_all();
+}
+
+// waits the end of the jobs, the first failure stops the others
+bool Operation::waitJobs(std::size_t jobs) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(endedJobs < jobs) {
+    ended.wait(lock);
+    if(failedJobs > 0 && run.load())
+      stop();
+  }
+  return failedJobs == 0;
+}
+
 bool Operation::checkTables(const strings& src, const strings& dest) {
   run = true;
   if(config.tables.empty()) {
@@ -78,9 +98,39 @@ bool Operation::checkMetadata() {
   bool checkColumns = true;
   std::for_each(
       tables.begin(), tables.end(), [&](const std::string& table) { checkColumns &= checkMetadataColumns(table); });
+  if(checkColumns)
+    schedule();
   return run = checkColumns;
 }
 
+// estimated bytes read for a table: the keys of both sides, the records missing in
+// target and with update the records of both sides hashed for the md5 compare
+std::size_t Operation::tableCost(const std::string& table) const {
+  const std::size_t KEY_BYTES = 16;
+  auto& src = fromDb->metadata(table);
+  auto& dest = toDb->metadata(table);
+  std::size_t cost = (src.rows + dest.rows) * KEY_BYTES;
+  if(src.rows > dest.rows)
+    cost += src.bytes / src.rows * (src.rows - dest.rows);
+  if(config.update)
+    cost += src.bytes + dest.bytes;
+  return cost;
+}
+
+// the most expensive tables are processed first, so that the last ones to finish
+// are small and the jobs end at about the same time
+void Operation::schedule() {
+  std::vector<std::pair<std::size_t, std::string>> costs;
+  for(auto& table : tables)
+    costs.emplace_back(tableCost(table), table);
+  std::stable_sort(costs.begin(), costs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+  queue.clear();
+  for(auto& [cost, table] : costs) {
+    LOG4CXX_DEBUG_FMT(log, "`{}` estimated cost {}", table, cost);
+    queue.push_back(TableChunk{ .table = table });
+  }
+}
+
 bool Operation::checkMetadataColumns(const std::string& table) {
   auto src = fromDb->metadata().at(table);
   auto dest = toDb->metadata().at(table);
@@ -101,11 +151,25 @@ bool Operation::checkMetadataColumns(const std::string& table) {
   return columnsOk;
 }
 
-std::string Operation::tableToProcess() {
+// tasks of the jobs run in parallel with them
+void Operation::startPool(std::size_t threads) {
+  LOG4CXX_DEBUG_FMT(log, "thread pool of {} threads", threads);
+  tasks = std::make_unique<util::thread::Pool>(threads);
+}
+
+bool Operation::chunkToProcess(TableChunk& chunk) {
   std::lock_guard<std::mutex> lock(mutex);
-  if(tables.empty() || !run.load())
-    return {};
-  return tables.extract(tables.begin()).value();
+  if(queue.empty() || !run.load())
+    return false;
+  chunk = std::move(queue.front());
+  queue.pop_front();
+  return true;
+}
+
+// ranges of a split table go first, any idle job takes them
+void Operation::addChunk(const TableChunk& chunk) {
+  std::lock_guard<std::mutex> lock(mutex);
+  queue.push_front(chunk);
 }
 
 /*****************************************************************************/
@@ -114,6 +178,16 @@ OpJob::OpJob(std::shared_ptr<dbsync::Operation> m) noexcept
     : manager{ m }, log{ log4cxx::Logger::getLogger(LOG_OPERATION) }, ret{ false }, run{ false } {}
 
 bool OpJob::init() {
+  if(!connect())
+    return false;
+  // update phase with its own connections
+  if(manager->configuration().concurrentPhases)
+    if(!phases.emplace_back(manager).connect())
+      return false;
+  return true;
+}
+
+bool OpJob::connect() {
   fromDb = std::make_unique<dbsync::Db>(manager, manager->source());
   if(!fromDb->open())
     return false;
@@ -134,42 +208,99 @@ void OpJob::execute() {
   LOG4CXX_DEBUG_FMT(log, "start processing with configuration {}", manager->configuration());
   std::string mode{ manager->configuration().mode == Mode::Copy ? "copy" : "sync" };
   std::string dryRun{ manager->configuration().dryRun ? "dry run" : "" };
-  std::string table;
+  const std::size_t chunkRows = manager->configuration().chunkRows;
+  TableChunk chunk;
   run = ret = true;
-  while(ret && manager->canRun() && !(table = manager->tableToProcess()).empty()) {
+  while(ret && manager->canRun() && manager->chunkToProcess(chunk)) {
+    const std::string& table = chunk.table;
     auto src = manager->source()->metadata(table);
     if(src.columns.empty()) {
       LOG4CXX_INFO_FMT(log, "`{}` empty table", table);
-    } else {
-      LOG4CXX_INFO_FMT(log, "`{}` {} {}", table, mode, dryRun);
-      TimerMs timerTable;
-      ret = execute(table);
-      LOG4CXX_INFO_FMT(log, "`{}` processed in {}", table, timerTable.elapsed().elapsed().string());
+      continue;
+    }
+    if(chunk.part == 0 && chunkRows > 0 && !manager->configuration().stream && src.rows > chunkRows) {
+      // a table with fewer rows than estimated is not split, it is processed here
+      bool split;
+      ret = splitTable(table, split);
+      if(!ret || split)
+        continue;
     }
+    LOG4CXX_INFO_FMT(log, "{} {} {}", chunk, mode, dryRun);
+    TimerMs timerTable;
+    ret = manager->configuration().stream ? executeStream(table) : execute(chunk);
+    LOG4CXX_INFO_FMT(log, "{} processed in {}", chunk, timerTable.elapsed().elapsed().string());
   }
   if(!manager->canRun())
     LOG4CXX_DEBUG(log, "stop requested");
   run = false;
+  manager->jobEnded(ret);
+}
+
+// the ranges of about chunkRows keys of a large table, walking the source primary key index;
+// each range is queued as soon as its upper bound is found, so idle jobs start on it
+bool OpJob::splitTable(const std::string& table, bool& split) {
+  const std::size_t chunkRows = manager->configuration().chunkRows;
+  TableChunk chunk{ .table = table, .part = 1 };
+  TableKeys previous;
+  while(manager->canRun()) {
+    TableKeys bound;
+    if(!fromDb->loadPkBound(table, chunkRows, bound, chunk.from)) {
+      LOG4CXX_ERROR_FMT(log, "`{}` split failed {}", table, fromDb->lastError());
+      return false;
+    }
+    manager->addRw(1);
+    if(bound.size() == 0)
+      break;
+    // the seek moves forward from the previous bound, else the ranges would repeat or overlap
+    // (string keys follow the server collation, they are only checked to differ)
+    bool forward = previous.size() == 0
+                || (bound.hasStrings() ? bound.record(0) != previous.record(0) : previous.less(0, bound, 0));
+    assert(forward);
+    if(!forward) {
+      LOG4CXX_WARN_FMT(log, "`{}` split stopped, bound not after the previous one", table);
+      break;
+    }
+    chunk.to = bound.record(0);
+    manager->addChunk(chunk);
+    chunk = TableChunk{ .table = table, .from = bound.record(0), .part = chunk.part + 1 };
+    previous = std::move(bound);
+  }
+  split = chunk.part > 1;
+  if(!split) {
+    LOG4CXX_DEBUG_FMT(log, "`{}` not split, less than {} keys", table, chunkRows);
+    return true;
+  }
+  manager->addChunk(chunk);
+  LOG4CXX_INFO_FMT(log, "`{}` split in {} ranges of {} keys", table, chunk.part, chunkRows);
+  return true;
 }
 
-bool OpJob::execute(const std::string& table) {
-  LOG4CXX_DEBUG_FMT(log, "`{}` start processing", table);
+bool OpJob::execute(const TableChunk& chunk) {
+  const std::string& table = chunk.table;
+  LOG4CXX_DEBUG_FMT(log, "{} start processing", chunk);
+  // a range of a split table is loaded without the parallel key loading
+  auto loadPk = [&](Db& db, bool source, TableKeys& keys) {
+    if(chunk.part == 0)
+      return db.loadPk(source, table, keys, manager->configuration().pkBulk);
+    keys.reserve(manager->configuration().chunkRows);
+    return db.loadPkRange(source, table, keys, manager->configuration().pkBulk, chunk.from, chunk.to);
+  };
   // load source primary key
-  TableKeys srcKeys;
-  auto srcLoad = std::async(std::launch::async, [&] {
-    auto loaded = fromDb->loadPk(true, table, srcKeys, manager->configuration().pkBulk);
+  TableKeys srcKeys = newKeys();
+  auto srcLoad = manager->pool().submit([&] {
+    auto loaded = loadPk(*fromDb, true, srcKeys);
     if(loaded) {
-      srcKeys.sort("source");
+      srcKeys.sort("source", manager->configuration().sortJobs);
       manager->addRw(srcKeys.size());
     }
     return loaded;
   });
   // load target primary key
-  TableKeys destKeys;
-  auto destLoad = std::async(std::launch::async, [&] {
-    auto loaded = toDb->loadPk(false, table, destKeys, manager->configuration().pkBulk);
+  TableKeys destKeys = newKeys();
+  auto destLoad = manager->pool().submit([&] {
+    auto loaded = loadPk(*toDb, false, destKeys);
     if(loaded) {
-      destKeys.sort("target");
+      destKeys.sort("target", manager->configuration().sortJobs);
       manager->addRw(destKeys.size());
     }
     return loaded;
@@ -184,12 +315,23 @@ bool OpJob::execute(const std::string& table) {
   if(!manager->canRun())
     return false;
   assert(loaded);
+  return executeKeys(table, srcKeys, destKeys);
+}
+
+TableKeys OpJob::newKeys() const {
+  auto& config = manager->configuration();
+  return TableKeys{ config.encodeKeys, config.update && config.pkChecksum };
+}
+
+bool OpJob::executeKeys(const std::string& table, TableKeys& srcKeys, TableKeys& destKeys) {
   // compare primary keys between source and target
   auto diff = compareKeys(table, srcKeys, destKeys);
   if(!manager->canRun())
     return false;
+  if(!phases.empty())
+    return executePhases(table, srcKeys, destKeys, diff);
   // copy records from source to target
-  if(!executeAdd(table, srcKeys, std::get<0>(diff)))
+  if(!executeAdd(table, srcKeys, srcKeys.flagSet(), std::get<0>(diff)))
     return false;
   // update records from source to target
   if(manager->configuration().update)
@@ -202,60 +344,335 @@ bool OpJob::execute(const std::string& table) {
   return true;
 }
 
-bool OpJob::executeAdd(const std::string& table, TableKeys& srcKeys, std::size_t total) {
+bool OpJob::executeStream(const std::string& table) {
+  LOG4CXX_DEBUG_FMT(log, "`{}` start streaming", table);
+  const std::size_t bulk = manager->configuration().pkBulk;
+  TimerMs timer;
+  std::size_t loaded = 0;
+  DbRecord lower;
+  bool last = false;
+  progress(log, table, timer, "streaming keys", loaded);
+  // the table is processed in windows (lower, upper] delimited by the server key
+  // order, so both sides always hold the same key range whatever the collation;
+  // the next source window is read while the target window is
+  auto loadSource = [&](TableKeys& keys, const DbRecord& after, const DbRecord& upTo) {
+    if(fromDb->loadPkWindow(table, keys, bulk, after, upTo))
+      return true;
+    LOG4CXX_ERROR_FMT(log, "`{}` source key loading failed {}", table, fromDb->lastError());
+    return false;
+  };
+  TableKeys srcKeys = newKeys();
+  if(!loadSource(srcKeys, lower, {}))
+    return false;
+  while(!last) {
+    last = srcKeys.size() < bulk;
+    DbRecord upper = last ? DbRecord{} : srcKeys.record(srcKeys.size() - 1);
+    TableKeys nextKeys = newKeys();
+    bool ahead = !last;
+    util::thread::Task<bool> prefetch;
+    if(ahead)
+      prefetch = manager->pool().submit([&] { return loadSource(nextKeys, upper, {}); });
+    TableKeys destKeys = newKeys();
+    bool destLoaded = toDb->loadPkWindow(table, destKeys, bulk, lower, upper);
+    if(prefetch.valid() && !prefetch.get())
+      return false;
+    if(!destLoaded) {
+      LOG4CXX_ERROR_FMT(log, "`{}` target key loading failed {}", table, toDb->lastError());
+      return false;
+    }
+    if(destKeys.size() == bulk) {
+      // target is denser than source: close the window on the last target key,
+      // the next source window read ahead starts after the wrong key
+      last = false;
+      ahead = false;
+      upper = destKeys.record(destKeys.size() - 1);
+      srcKeys = newKeys();
+      if(!loadSource(srcKeys, lower, upper))
+        return false;
+    }
+    if(!manager->canRun())
+      return false;
+    manager->addRw(srcKeys.size() + destKeys.size());
+    loaded += srcKeys.size() + destKeys.size();
+    LOG4CXX_DEBUG_FMT(log, "`{}` window [source: {}] [target: {}]", table, srcKeys.size(), destKeys.size());
+    srcKeys.sort("source", manager->configuration().sortJobs);
+    destKeys.sort("target", manager->configuration().sortJobs);
+    if(!executeKeys(table, srcKeys, destKeys))
+      return false;
+    lower = std::move(upper);
+    progress(log, table, timer, "streaming keys", loaded);
+    if(last)
+      break;
+    if(ahead) {
+      srcKeys = std::move(nextKeys);
+    } else {
+      srcKeys = newKeys();
+      if(!loadSource(srcKeys, lower, {}))
+        return false;
+    }
+  }
+  progress(log, table, timer, "streamed keys", loaded);
+  return true;
+}
+
+// the delete runs first: its next-key locks on the key gaps would deadlock with the inserts
+// of the copy; then copy and update, touching disjoint existing and new keys, run at the same
+// time, the update on the connections of the phase job. A replace takes the same next-key
+// locks of a delete, so with update mode replace the update runs after the copy
+bool OpJob::executePhases(const std::string& table,
+                          TableKeys& srcKeys,
+                          TableKeys& destKeys,
+                          const std::tuple<std::size_t, std::size_t, std::size_t>& diff) {
+  assert(phases.size() == 1);
+  if(manager->configuration().mode == Mode::Sync)
+    if(!executeDelete(table, destKeys, std::get<2>(diff)))
+      return false;
+  if(manager->configuration().updateMode == UpdateMode::Replace) {
+    if(!executeAdd(table, srcKeys, srcKeys.flagSet(), std::get<0>(diff)))
+      return false;
+    return !manager->configuration().update || executeUpdate(table, srcKeys, std::get<1>(diff));
+  }
+  // the update changes the source keys flags, the copy iterates a copy of them
+  KeyFlags added = srcKeys.flagSet();
+  // the update waits for tasks of the pool, so it runs on its own thread
+  auto update = std::async(std::launch::async, [&] {
+    return !manager->configuration().update || phases[0].executeUpdate(table, srcKeys, std::get<1>(diff));
+  });
+  bool copied = executeAdd(table, srcKeys, added, std::get<0>(diff));
+  return update.get() && copied;
+}
+
+bool OpJob::executeAdd(const std::string& table, TableKeys& srcKeys, const KeyFlags& flags, std::size_t total) {
   if(total == 0)
     return true;
   TimerMs timer{ total };
   std::size_t count = 0;
-  std::size_t bulk = std::min(total, manager->configuration().modifyBulk);
-  TableData srcRecord{ true, table, bulk };
-  TableKeysIterator indexIter = srcKeys.iter(true);
   toDb->insertPrepare(table);
   progress(log, table, timer, "copy", count, total);
-  while(!indexIter.end()) {
-    bulk = std::min(total - count, manager->configuration().modifyBulk);
-    if(count == 0 || bulk < manager->configuration().modifyBulk)
-      fromDb->selectPrepare(table, srcKeys.columnNames(), bulk);
+  bool copied = readBlocks(table, srcKeys, flags, total, {}, [&](TableData& srcRecord) {
+    progress(log, table, timer, "copy load", count + srcRecord.size(), total);
+    if(manager->configuration().loadData) {
+      if(executeLoadData(table, srcRecord)) {
+        count += srcRecord.size();
+        manager->addRw(srcRecord.size());
+        progress(log, table, timer, "load data", count, total);
+        return true;
+      }
+      // a failed block is retried with inserts, skipping the failing records
+      if(!manager->configuration().noFail)
+        return false;
+      LOG4CXX_WARN_FMT(log, "`{}` load data failed, retry with inserts", table);
+    }
+    toDb->transactionBegin();
+    for(std::size_t i = 0; i < srcRecord.size();) {
+      std::size_t rows = batchRows(srcRecord, i);
+      LOG4CXX_TRACE_FMT(log, "`{}` insert {}-{}", table, count + i + 1, count + i + rows);
+      bool inserted = manager->configuration().dryRun;
+      if(!inserted && rows > 1) {
+        inserted = toDb->insertExecute(table, srcRecord, i, i + rows);
+        if(!inserted)
+          LOG4CXX_WARN_FMT(log, "`{}` multi-row insert failed, retry one by one: {}", table, toDb->lastError());
+      }
+      // single record inserts, also the fallback of a failed multi-row insert
+      for(std::size_t r = i; !inserted && r < i + rows; r++) {
+        LOG4CXX_TRACE_FMT(log, "`{}` insert {}: {}", table, count + r + 1, srcRecord.rowString(r));
+        if(!toDb->insertExecute(table, srcRecord.at(r))) {
+          auto record = srcRecord.rowString(r);
+          LOG4CXX_ERROR_FMT(log, "`{}` insert failed {} {}", table, record, toDb->lastError());
+          if(!manager->configuration().noFail)
+            return false;
+        }
+      }
+      i += rows;
+      if(feedback(count + i, srcRecord.size(), total))
+        progress(log, table, timer, "insert", count + i, total);
+      if(!manager->canRun())
+        return false;
+    }
+    toDb->transactionCommit();
+    count += srcRecord.size();
+    manager->addRw(srcRecord.size());
+    return true;
+  });
+  if(!copied)
+    return false;
+  progress(log, table, timer, "copied", count);
+  return true;
+}
+
+// reads the records of the flagged keys block by block and passes each one to write;
+// with option pipeline the next block is read while the current one is written
+bool OpJob::readBlocks(const std::string& table,
+                       TableKeys& srcKeys,
+                       const KeyFlags& flags,
+                       std::size_t total,
+                       const strings& columns,
+                       const std::function<bool(TableData&)>& write) {
+  const std::size_t modifyBulk = manager->configuration().modifyBulk;
+  const bool pipeline = manager->configuration().pipeline;
+  std::size_t read = 0;
+  TableData first{ true, table, std::min(total, modifyBulk) };
+  TableData second{ true, table, pipeline ? std::min(total, modifyBulk) : 0 };
+  TableData* current = &first;
+  TableData* next = &second;
+  TableKeysIterator indexIter = srcKeys.iter(true, flags);
+  auto load = [&](TableData& srcRecord) {
+    std::size_t bulk = std::min(read < total ? total - read : 1, modifyBulk);
+    if(read == 0 || bulk < modifyBulk)
+      fromDb->selectPrepare(table, srcKeys.columnNames(), bulk, columns);
     srcRecord.clear();
     if(!fromDb->selectExecute(table, srcKeys, indexIter, srcRecord)) {
       auto r = srcKeys.rowString(indexIter.value());
       LOG4CXX_ERROR_FMT(log, "`{}` select failed at key {} {}", table, r, fromDb->lastError());
       return false;
     }
-    assert(srcRecord.size() > 0);
-    progress(log, table, timer, "copy load", count + srcRecord.size(), total);
+    read += srcRecord.size();
+    return true;
+  };
+  if(!load(*current))
+    return false;
+  while(current->size() > 0 || !indexIter.end()) {
+    // the source connection and the iterator are used only by the reader until get()
+    util::thread::Task<bool> prefetch;
+    if(pipeline && !indexIter.end())
+      prefetch = manager->pool().submit([&] { return load(*next); });
+    if(current->size() > 0 && !write(*current))
+      return false;
+    bool loaded = true;
+    if(prefetch.valid())
+      loaded = prefetch.get();
+    else if(!indexIter.end())
+      loaded = load(*next);
+    else
+      next->clear();
+    if(!loaded)
+      return false;
+    std::swap(current, next);
+  }
+  return true;
+}
+
+bool OpJob::executeLoadData(const std::string& table, TableData& srcRecord) {
+  if(manager->configuration().dryRun)
+    return true;
+  std::size_t loaded;
+  toDb->transactionBegin();
+  if(!toDb->loadDataExecute(table, srcRecord, 0, srcRecord.size(), loaded)) {
+    LOG4CXX_ERROR_FMT(log, "`{}` load data failed {}", table, toDb->lastError());
+    toDb->transactionRollback();
+    return false;
+  }
+  if(loaded < srcRecord.size()) {
+    LOG4CXX_ERROR_FMT(log, "`{}` load data skipped {} records of {}", table, srcRecord.size() - loaded, srcRecord.size());
+    if(!manager->configuration().noFail) {
+      toDb->transactionRollback();
+      return false;
+    }
+  }
+  toDb->transactionCommit();
+  return true;
+}
+
+bool OpJob::executeUpdate(const std::string& table, TableKeys& srcKeys, std::size_t total) {
+  if(total == 0)
+    return true;
+  // filter record which need to be updateb (md5 sum fileds compare)
+  ColumnChanges changes;
+  if(srcKeys.hasDigests()) {
+    // md5 loaded with the primary keys, changed records flagged by compareKeys
+    srcKeys.flagChanged();
+  } else {
+    srcKeys.revertFlags();
+    if(manager->configuration().rangeChecksum && !srcKeys.hasStrings()) {
+      if(!compareRanges(table, srcKeys))
+        return false;
+      total = srcKeys.size(true);
+    }
+    if(total > 0 && !compareRecords(table, srcKeys, total, changes))
+      return false;
+  }
+  // begin updates
+  total = srcKeys.size(true);
+  if(total == 0) {
+    LOG4CXX_INFO_FMT(log, "`{}` no record to update found", table);
+    return true;
+  }
+  LOG4CXX_INFO_FMT(log, "`{}` {} records to update found", table, total);
+  if(changes.empty())
+    return updateRecords(table, srcKeys, total, {});
+  // one pass for each set of changed columns
+  for(auto& [columns, positions] : changes) {
+    LOG4CXX_DEBUG_FMT(log, "`{}` {} records with changed [{}]", table, positions.size(), ba::join(columns, ","));
+    srcKeys.setFlags(0, srcKeys.size(), false);
+    for(auto position : positions)
+      srcKeys.setFlag(position);
+    if(!updateRecords(table, srcKeys, positions.size(), columns))
+      return false;
+  }
+  return true;
+}
+
+bool OpJob::updateRecords(const std::string& table, TableKeys& srcKeys, std::size_t total, const strings& columns) {
+  // batches write whole records, an upsert sets only the changed columns
+  const bool batch = manager->configuration().updateMode != UpdateMode::Single;
+  TimerMs timer{ total };
+  std::size_t count = 0;
+  progress(log, table, timer, "update", count, total);
+  strings read = batch ? strings{} : columns;
+  bool applied = readBlocks(table, srcKeys, srcKeys.flagSet(), total, read, [&](TableData& srcRecord) {
+    manager->addRw(srcRecord.size());
+    progress(log, table, timer, "update load", count + srcRecord.size(), total);
+    if(count == 0)
+      toDb->updatePrepare(table, srcKeys.columnNames(), srcRecord.columnNames());
+    strings fields = columns;
+    if(fields.empty())
+      for(auto& name : srcRecord.columnNames())
+        if(std::find(srcKeys.columnNames().begin(), srcKeys.columnNames().end(), name) == srcKeys.columnNames().end())
+          fields.push_back(name);
     toDb->transactionBegin();
-    for(int i = 0; i < srcRecord.size(); i++) {
-      if(feedback(count + i + 1, srcRecord.size(), total))
-        progress(log, table, timer, "insert", count + i + 1, total);
-      LOG4CXX_TRACE_FMT(log, "`{}` insert {}: {}", table, count + i + 1, srcRecord.rowString(i));
-      if(!manager->configuration().dryRun && !toDb->insertExecute(table, srcRecord.at(i))) {
-        auto record = srcRecord.rowString(i);
-        LOG4CXX_ERROR_FMT(log, "`{}` insert failed {} {}", table, record, toDb->lastError());
-        if(!manager->configuration().noFail)
-          return false;
+    for(std::size_t i = 0; i < srcRecord.size();) {
+      std::size_t rows = batch ? batchRows(srcRecord, i) : 1;
+      bool updated = manager->configuration().dryRun;
+      if(!updated && rows > 1) {
+        bool replace = manager->configuration().updateMode == UpdateMode::Replace;
+        updated = toDb->upsertExecute(table, srcRecord, i, i + rows, fields, replace);
+        if(!updated)
+          LOG4CXX_WARN_FMT(log, "`{}` multi-row update failed, retry one by one: {}", table, toDb->lastError());
+      }
+      // single record updates, also the fallback of a failed multi-row update
+      for(std::size_t r = i; !updated && r < i + rows; r++) {
+        LOG4CXX_TRACE_FMT(log, "update {}: {}", count + r + 1, srcRecord.rowString(r));
+        if(!toDb->updateExecute(table, srcRecord.at(r))) {
+          auto record = srcRecord.rowString(r);
+          LOG4CXX_ERROR_FMT(log, "`{}` update failed for {} {}", table, record, toDb->lastError());
+          if(!manager->configuration().noFail)
+            return false;
+        }
       }
+      i += rows;
+      if(feedback(count + i, srcRecord.size(), total))
+        progress(log, table, timer, "update", count + i, total);
       if(!manager->canRun())
         return false;
     }
     toDb->transactionCommit();
     count += srcRecord.size();
     manager->addRw(srcRecord.size());
-  }
-  progress(log, table, timer, "copied", count);
+    return true;
+  });
+  if(!applied)
+    return false;
+  progress(log, table, timer, "updated", count);
   return true;
 }
 
-bool OpJob::executeUpdate(const std::string& table, TableKeys& srcKeys, std::size_t total) {
-  if(total == 0)
-    return true;
+bool OpJob::compareRecords(const std::string& table, TableKeys& srcKeys, std::size_t total, ColumnChanges& changes) {
+  const bool columns = manager->configuration().partialUpdate;
   TimerMs timer{ total };
   std::size_t count = 0;
   std::size_t bulk = std::min(total, manager->configuration().compareBulk);
   TableData srcCompare{ true, table, bulk, true };
   TableData destCompare{ false, table, bulk, true };
-  // filter record which need to be updateb (md5 sum fileds compare)
-  srcKeys.revertFlags();
   TableKeysIterator fromIter = srcKeys.iter(true);
   TableKeysIterator toIter = srcKeys.iter(true);
   progress(log, table, timer, "compare fields md5", 0, total);
@@ -263,14 +680,14 @@ bool OpJob::executeUpdate(const std::string& table, TableKeys& srcKeys, std::siz
     TableKeysIterator iter{ fromIter };
     bulk = std::min(total - count, manager->configuration().modifyBulk);
     if(count == 0 || bulk < manager->configuration().modifyBulk) {
-      fromDb->comparePrepare(table, bulk);
-      toDb->comparePrepare(table, bulk);
+      fromDb->comparePrepare(table, bulk, columns);
+      toDb->comparePrepare(table, bulk, columns);
     }
-    auto srcLoad = std::async(std::launch::async, [&] {
+    auto srcLoad = manager->pool().submit([&] {
       srcCompare.clear();
       return fromDb->selectExecute(table, srcKeys, fromIter, srcCompare);
     });
-    auto destLoad = std::async(std::launch::async, [&] {
+    auto destLoad = manager->pool().submit([&] {
       destCompare.clear();
       return toDb->selectExecute(table, srcKeys, toIter, destCompare);
     });
@@ -300,7 +717,19 @@ bool OpJob::executeUpdate(const std::string& table, TableKeys& srcKeys, std::siz
 #endif
       Field& srcMd5 = *srcRow.checkValue();
       Field& destMd5 = *destRow.checkValue();
-      srcKeys.setFlag(iter.value(), srcMd5 <=> destMd5 != std::partial_ordering::equivalent);
+      bool changed = srcMd5 <=> destMd5 != std::partial_ordering::equivalent;
+      srcKeys.setFlag(iter.value(), changed);
+      if(changed && columns) {
+        // fields between the key and the md5 are the columns crc32
+        const auto& names = srcCompare.columnNames();
+        strings fields;
+        for(std::size_t f = srcKeys.columnNames().size(); f < names.size(); f++)
+          if(*srcRow.at(f) <=> *destRow.at(f) != std::partial_ordering::equivalent)
+            fields.push_back(names[f]);
+        if(fields.empty()) // crc32 collision
+          fields.assign(names.begin() + srcKeys.columnNames().size(), names.end());
+        changes[fields].push_back(iter.value());
+      }
       ++iter;
     }
     if(!manager->canRun())
@@ -308,53 +737,68 @@ bool OpJob::executeUpdate(const std::string& table, TableKeys& srcKeys, std::siz
     progress(log, table, timer, "comparing fields md5", count, total);
   }
   progress(log, table, timer, "compared fields md5", total);
-  // begin updates
-  total = srcKeys.size(true);
-  if(total == 0) {
-    LOG4CXX_INFO_FMT(log, "`{}` no record to update found", table);
-    return true;
-  }
-  bulk = std::min(total, manager->configuration().modifyBulk);
-  TableData srcRecord{ true, table, bulk };
-  LOG4CXX_INFO_FMT(log, "`{}` {} records to update found", table, total);
-  timer.reset(total);
-  TableKeysIterator indexIter = srcKeys.iter(true);
-  count = 0;
-  progress(log, table, timer, "update", count, total);
-  while(!indexIter.end()) {
-    bulk = std::min(total - count, manager->configuration().modifyBulk);
-    if(count == 0 || bulk < manager->configuration().modifyBulk)
-      fromDb->selectPrepare(table, srcKeys.columnNames(), bulk);
-    srcRecord.clear();
-    if(!fromDb->selectExecute(table, srcKeys, indexIter, srcRecord)) {
-      auto r = srcKeys.rowString(indexIter.value());
-      LOG4CXX_ERROR_FMT(log, "`{}` select failed at key {} {}", table, r, fromDb->lastError());
+  return true;
+}
+
+// bisection of the key space: ranges with the same rows count and checksum on both
+// sides are unflagged, ranges that differ are split down to compareBulk keys whose
+// records are then compared one by one
+bool OpJob::compareRanges(const std::string& table, TableKeys& srcKeys) {
+  const std::size_t FANOUT = 16;
+  const std::size_t leaf = manager->configuration().compareBulk;
+  const std::size_t total = srcKeys.size(true);
+  TimerMs timer{ total };
+  std::size_t queries = 0;
+  std::vector<std::pair<std::size_t, std::size_t>> ranges{ { 0, srcKeys.size() } };
+  progress(log, table, timer, "compare ranges checksum", 0, total);
+  while(!ranges.empty()) {
+    auto [from, to] = ranges.back();
+    ranges.pop_back();
+    if(srcKeys.nextFlag(from, true) >= to)
+      continue;
+    DbRecord lower = srcKeys.sortedRecord(from);
+    DbRecord upper = srcKeys.sortedRecord(to - 1);
+    DbRecord srcChecksum;
+    DbRecord destChecksum;
+    auto srcLoad = manager->pool().submit([&] {
+      return fromDb->rangeChecksum(table, lower, upper, srcChecksum);
+    });
+    auto destLoad = manager->pool().submit([&] {
+      return toDb->rangeChecksum(table, lower, upper, destChecksum);
+    });
+    bool loaded = srcLoad.get() && destLoad.get();
+    if(!loaded) {
+      LOG4CXX_ERROR_FMT(
+          log, "`{}` range checksum failed - source [{}] target [{}]", table, fromDb->lastError(), toDb->lastError());
       return false;
     }
-    assert(srcRecord.size() > 0);
-    manager->addRw(srcRecord.size());
-    progress(log, table, timer, "update load", count + srcRecord.size(), total);
-    if(count == 0)
-      toDb->updatePrepare(table, srcKeys.columnNames(), srcRecord.columnNames());
-    toDb->transactionBegin();
-    for(int i = 0; i < srcRecord.size(); i++) {
-      if(feedback(count + i + 1, srcRecord.size(), total))
-        progress(log, table, timer, "update", count + i + 1, total);
-      LOG4CXX_TRACE_FMT(log, "update {}: {}", count + i + 1, srcRecord.rowString(i));
-      if(!manager->configuration().dryRun && !toDb->updateExecute(table, srcRecord.at(i))) {
-        auto record = srcRecord.rowString(i);
-        LOG4CXX_ERROR_FMT(log, "`{}` update failed for {} {}", table, record, toDb->lastError());
-        if(!manager->configuration().noFail)
-          return false;
-      }
-      if(!manager->canRun())
-        return false;
+    queries++;
+    manager->addRw(2);
+    // the source range holds exactly the keys of the slice, else the bounds select other rows
+    assert(std::visit(
+               [](const auto& v) -> std::size_t {
+                 if constexpr(std::is_arithmetic_v<std::decay_t<decltype(v)>>)
+                   return static_cast<std::size_t>(v);
+                 else
+                   return 0;
+               },
+               srcChecksum.at(0).second)
+           == to - from);
+    if(srcChecksum == destChecksum) {
+      srcKeys.setFlags(from, to, false);
+      progress(log, table, timer, "comparing ranges checksum", total - srcKeys.size(true), total);
+    } else if(to - from > leaf) {
+      std::size_t step = (to - from + FANOUT - 1) / FANOUT;
+      // pushed in reverse so that ranges are processed in key order
+      for(std::size_t c = (to - from + step - 1) / step; c > 0; c--)
+        ranges.emplace_back(from + (c - 1) * step, std::min(to, from + c * step));
     }
-    toDb->transactionCommit();
-    count += srcRecord.size();
-    manager->addRw(srcRecord.size());
+    if(!manager->canRun())
+      return false;
   }
-  progress(log, table, timer, "updated", count);
+  progress(log, table, timer, "compared ranges checksum", total - srcKeys.size(true), total);
+  LOG4CXX_DEBUG_FMT(
+      log, "`{}` range checksum [ranges: {}] [records to compare: {}]", table, queries, srcKeys.size(true));
   return true;
 }
 
@@ -363,31 +807,51 @@ bool OpJob::executeDelete(const std::string& table, TableKeys& destKeys, std::si
     return true;
   TimerMs timer{ total };
   std::size_t count = 0;
+  std::size_t bulk = std::min(total, manager->configuration().deleteBulk);
   TableKeysIterator indexIter = destKeys.iter(true);
-  toDb->deletePrepare(table, destKeys.columnNames());
-  count = 0;
   progress(log, table, timer, "deleting", count, total);
-  toDb->transactionBegin();
+  // each statement is committed on its own to keep undo log and locks bounded
   while(!indexIter.end()) {
-    if(feedback(++count, total, total))
-      progress(log, table, timer, "deleting", count, total);
-    LOG4CXX_TRACE_FMT(log, "`{}` delete {}: {}", table, count, destKeys.rowString(indexIter.value()));
-    if(!manager->configuration().dryRun && !toDb->deleteExecute(table, destKeys, indexIter.value())) {
-      auto record = destKeys.rowString(indexIter.value());
-      LOG4CXX_ERROR_FMT(log, "`{}` delete failed {} {}", table, record, toDb->lastError());
+    bulk = std::min(total - count, manager->configuration().deleteBulk);
+    if(count == 0 || bulk < manager->configuration().deleteBulk)
+      toDb->deletePrepare(table, destKeys.columnNames(), bulk);
+    auto first = destKeys.rowString(indexIter.value());
+    std::size_t deleted = bulk;
+    toDb->transactionBegin();
+    if(manager->configuration().dryRun) {
+      for(std::size_t i = 0; i < bulk; i++)
+        ++indexIter;
+    } else if(!toDb->deleteExecute(table, destKeys, indexIter, deleted)) {
+      LOG4CXX_ERROR_FMT(log, "`{}` delete of {} keys from {} failed {}", table, deleted, first, toDb->lastError());
       if(!manager->configuration().noFail)
         return false;
     }
+    toDb->transactionCommit();
+    LOG4CXX_TRACE_FMT(log, "`{}` delete {}-{} from {}", table, count + 1, count + deleted, first);
+    count += deleted;
+    manager->addRw(deleted);
+    if(feedback(count, total, total))
+      progress(log, table, timer, "deleting", count, total);
     if(!manager->canRun())
       return false;
-    ++indexIter;
-    manager->addRw(1);
   }
-  toDb->transactionCommit();
   progress(log, table, timer, "deleted", count);
   return true;
 }
 
+// records from first that fit a multi-row statement
+std::size_t OpJob::batchRows(const TableData& data, std::size_t first) const {
+  std::size_t bytes = 0;
+  std::size_t last = first;
+  while(last < data.size() && last - first < manager->configuration().insertRows) {
+    bytes += data.at(last)->bytes();
+    if(last > first && bytes > manager->configuration().insertBytes)
+      break;
+    last++;
+  }
+  return last - first;
+}
+
 bool OpJob::feedback(const std::size_t count, const std::size_t bulk, const std::size_t total) const {
   if(count == total)
     return true;
@@ -404,29 +868,12 @@ bool OpJob::feedback(const std::size_t count, const std::size_t bulk, const std:
 
 std::tuple<std::size_t, std::size_t, std::size_t>
 OpJob::compareKeys(const std::string& table, TableKeys& src, TableKeys& dest) {
-  std::size_t srcIndex = 0;
-  std::size_t destIndex = 0;
-  while(srcIndex < src.size() && destIndex < dest.size()) {
-    if(src.less(srcIndex, dest, destIndex)) {
-      src.setFlag(srcIndex++);
-    } else if(dest.less(destIndex, src, srcIndex)) {
-      dest.setFlag(destIndex++);
-    } else {
-      srcIndex++;
-      destIndex++;
-    }
-  }
-  while(srcIndex < src.size())
-    src.setFlag(srcIndex++);
-  while(destIndex < dest.size())
-    dest.setFlag(destIndex++);
-  assert(srcIndex == src.size());
-  assert(destIndex == dest.size());
+  src.diff(dest);
   std::size_t onlySrc = src.size(true);
   std::size_t common = src.size() - onlySrc;
   std::size_t onlyDest = dest.size(true);
   assert(common == dest.size() - onlyDest);
-  LOG4CXX_DEBUG_FMT(log, "`{}` records: source {} target {}", table, srcIndex, destIndex);
+  LOG4CXX_DEBUG_FMT(log, "`{}` records: source {} target {}", table, src.size(), dest.size());
   LOG4CXX_INFO_FMT(log,
                    "`{}` primary key compare [only source: {}] [common: {}] [only target: {}]",
                    table,
@@ -499,6 +946,14 @@ void TableRow::rotate(const int moveCount) {
   std::rotate(fields.begin(), it, fields.end());
 }
 
+// approximate size of the record values
+std::size_t TableRow::bytes() const {
+  std::size_t total = 0;
+  for(auto& field : fields)
+    total += field->isString() || field->type() == soci::dt_date ? field->asString().size() : sizeof(long long);
+  return total;
+}
+
 std::string TableRow::toString() const {
   const int end = updateCheck ? fields.size() - 1 : fields.size();
   return toString(strings(end, ""));
@@ -536,10 +991,53 @@ std::ostream& operator<<(std::ostream& stream, const Mode& var) {
   }
 }
 
+std::ostream& operator<<(std::ostream& stream, const TableChunk& var) {
+  stream << '`' << var.table << '`';
+  if(var.part > 0)
+    stream << " [range " << var.part << ']';
+  return stream;
+}
+
+std::ostream& operator<<(std::ostream& stream, const UpdateMode& var) {
+  switch(var) {
+  case UpdateMode::Single:
+    return stream << "single";
+  case UpdateMode::Upsert:
+    return stream << "upsert";
+  case UpdateMode::Replace:
+    return stream << "replace";
+  }
+  return stream << "Unknown update mode";
+}
+
 std::ostream& operator<<(std::ostream& stream, const OperationConfig& var) {
-  stream << "[mode: " << var.mode << "] [update: " << var.update << "] [dryRun: " << var.dryRun
-         << "] [tables: " << ba::join(var.tables, ",") << "] [disableBinLog: " << var.disableBinLog;
-  return stream << ']';
+  // one option per line, after the message that prints the configuration
+  return stream << "\n  mode: " << var.mode
+                << "\n  update: " << var.update
+                << "\n  rangeChecksum: " << var.rangeChecksum
+                << "\n  pkChecksum: " << var.pkChecksum
+                << "\n  updateMode: " << var.updateMode
+                << "\n  partialUpdate: " << var.partialUpdate
+                << "\n  loadData: " << var.loadData
+                << "\n  pipeline: " << var.pipeline
+                << "\n  concurrentPhases: " << var.concurrentPhases
+                << "\n  stream: " << var.stream
+                << "\n  encodeKeys: " << var.encodeKeys
+                << "\n  keyTable: " << var.keyTable
+                << "\n  dryRun: " << var.dryRun
+                << "\n  tables: " << ba::join(var.tables, ",")
+                << "\n  disableBinLog: " << var.disableBinLog
+                << "\n  noFail: " << var.noFail
+                << "\n  pkBulk: " << var.pkBulk
+                << "\n  pkJobs: " << var.pkJobs
+                << "\n  sortJobs: " << var.sortJobs
+                << "\n  compareBulk: " << var.compareBulk
+                << "\n  modifyBulk: " << var.modifyBulk
+                << "\n  chunkRows: " << var.chunkRows
+                << "\n  poolThreads: " << var.poolThreads
+                << "\n  deleteBulk: " << var.deleteBulk
+                << "\n  insertRows: " << var.insertRows
+                << "\n  insertBytes: " << var.insertBytes;
 }
 
 }
@@ -63,5 +63,41 @@ std::ostream& eraseRight(std::ostream& stream) { return stream << util::term::se
 std::ostream& eraseLeft(std::ostream& stream) { return stream << util::term::sequence::eraseLeft; }
 }
 
+}
+
+namespace thread {
+
+Pool::Pool(std::size_t threads) {
+  assert(threads > 0);
+  for(std::size_t i = 0; i < threads; i++)
+    workers.emplace_back([this] { work(); });
+}
+
+Pool::~Pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  ready.notify_all();
+  for(auto& worker : workers)
+    worker.join();
+}
+
+// runs the queued tasks until the pool is destroyed and the queue is empty
+void Pool::work() {
+  while(true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if(tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
 }
 }